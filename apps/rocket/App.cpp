@@ -76,12 +76,7 @@ AppDescription::read(std::string_view path, std::string_view iconDir) {
   }
 
   if (!result.icon.empty()) {
-    auto iconPath = std::string(iconDir) + '/' + result.icon + ".png";
-    std::cout << "Parsing image from: " << iconPath << std::endl;
-    result.iconImage = ImageCanvas::load(iconPath.c_str());
-    if (result.iconImage.has_value()) {
-      std::cout << result.iconImage->canvas.components() << std::endl;
-    }
+    result.iconPath = std::string(iconDir) + '/' + result.icon + ".png";
   }
 
   return std::optional(std::move(result));
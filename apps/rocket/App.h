@@ -24,8 +24,10 @@ struct AppDescription {
 
   std::string command;
   std::string icon;
+  std::string iconPath; // Full path of the icon image, empty if there's none.
 
-  std::optional<rmlib::ImageCanvas> iconImage;
+  /// Loaded in the background, see IconLoader.
+  std::optional<rmlib::MemoryCanvas> iconImage;
 
   static std::optional<AppDescription> read(std::string_view path,
                                             std::string_view iconDir);
@@ -0,0 +1,204 @@
+#include "IconLoader.h"
+
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <sstream>
+
+#include <sys/stat.h>
+
+using namespace rmlib;
+
+namespace {
+
+constexpr auto cache_dir_suffix = "/.cache/rocket/icons";
+constexpr uint32_t cache_magic = 0x31434952; // "RIC1"
+
+struct CacheHeader {
+  uint32_t magic;
+  int32_t width;
+  int32_t height;
+  int64_t mtime;
+  int64_t size;
+  uint32_t pathLength;
+};
+
+void
+makeDirectories(const std::string& path) {
+  for (auto pos = path.find('/', 1); pos != std::string::npos;
+       pos = path.find('/', pos + 1)) {
+    mkdir(path.substr(0, pos).c_str(), 0755);
+  }
+  mkdir(path.c_str(), 0755);
+}
+
+std::string
+getCachePath(const std::string& cacheDir, const std::string& path) {
+  std::stringstream ss;
+  ss << cacheDir << '/' << std::hex << std::hash<std::string>{}(path);
+  return ss.str();
+}
+
+std::optional<MemoryCanvas>
+readCache(const std::string& cachePath,
+          const std::string& path,
+          const struct stat& st,
+          Size iconSize) {
+  std::ifstream ifs(cachePath, std::ios::binary);
+  if (!ifs.is_open()) {
+    return std::nullopt;
+  }
+
+  CacheHeader header{};
+  if (!ifs.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+      header.magic != cache_magic || header.mtime != st.st_mtime ||
+      header.size != st.st_size || header.pathLength != path.size() ||
+      header.width <= 0 || header.width > iconSize.width ||
+      header.height <= 0 || header.height > iconSize.height) {
+    return std::nullopt;
+  }
+
+  std::string cachedPath(header.pathLength, '\0');
+  if (!ifs.read(cachedPath.data(), cachedPath.size()) || cachedPath != path) {
+    return std::nullopt;
+  }
+
+  auto result = MemoryCanvas(header.width, header.height, 2);
+  if (!ifs.read(reinterpret_cast<char*>(result.memory.get()),
+                result.canvas.totalSize())) {
+    return std::nullopt;
+  }
+
+  return result;
+}
+
+void
+writeCache(const std::string& cachePath,
+           const std::string& path,
+           const struct stat& st,
+           const Canvas& canvas) {
+  // Write to a temporary file first, so readers never see partial entries.
+  const auto tmpPath = cachePath + ".tmp";
+  {
+    std::ofstream ofs(tmpPath, std::ios::binary | std::ios::trunc);
+    if (!ofs.is_open()) {
+      return;
+    }
+
+    const auto header = CacheHeader{ cache_magic,
+                                     canvas.width(),
+                                     canvas.height(),
+                                     st.st_mtime,
+                                     st.st_size,
+                                     uint32_t(path.size()) };
+    ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    ofs.write(path.data(), path.size());
+    ofs.write(reinterpret_cast<const char*>(canvas.getMemory()),
+              canvas.totalSize());
+    if (!ofs) {
+      return;
+    }
+  }
+
+  std::rename(tmpPath.c_str(), cachePath.c_str());
+}
+
+} // namespace
+
+IconLoader::IconLoader(Size iconSize, int threads) : iconSize(iconSize) {
+  if (const auto* home = getenv("HOME"); home != nullptr) {
+    cacheDir = std::string(home) + cache_dir_suffix;
+    makeDirectories(cacheDir);
+  }
+
+  for (int i = 0; i < threads; i++) {
+    workers.emplace_back([this] { work(); });
+  }
+}
+
+IconLoader::~IconLoader() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  cond.notify_all();
+
+  for (auto& worker : workers) {
+    worker.join();
+  }
+}
+
+void
+IconLoader::request(const std::string& path) {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!pending.insert(path).second) {
+      return;
+    }
+    queue.push_back(path);
+  }
+  cond.notify_one();
+}
+
+std::vector<IconLoader::Result>
+IconLoader::takeResults() {
+  std::lock_guard<std::mutex> lock(mutex);
+  std::vector<Result> result;
+  std::swap(result, results);
+  return result;
+}
+
+bool
+IconLoader::hasPending() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return !pending.empty();
+}
+
+void
+IconLoader::work() {
+  std::unique_lock<std::mutex> lock(mutex);
+  while (true) {
+    cond.wait(lock, [this] { return stopping || !queue.empty(); });
+    if (stopping) {
+      return;
+    }
+
+    auto path = std::move(queue.front());
+    queue.pop_front();
+
+    lock.unlock();
+    auto icon = load(path);
+    lock.lock();
+
+    pending.erase(path);
+    results.push_back(Result{ std::move(path), std::move(icon) });
+  }
+}
+
+std::optional<MemoryCanvas>
+IconLoader::load(const std::string& path) const {
+  struct stat st {};
+  if (stat(path.c_str(), &st) != 0) {
+    return std::nullopt;
+  }
+
+  const auto cachePath =
+    cacheDir.empty() ? std::string() : getCachePath(cacheDir, path);
+  if (!cachePath.empty()) {
+    if (auto cached = readCache(cachePath, path, st, iconSize);
+        cached.has_value()) {
+      return cached;
+    }
+  }
+
+  auto image = ImageCanvas::load(path.c_str(), iconSize);
+  if (!image.has_value()) {
+    return std::nullopt;
+  }
+
+  if (!cachePath.empty()) {
+    writeCache(cachePath, path, st, image->canvas);
+  }
+
+  return MemoryCanvas(image->canvas);
+}
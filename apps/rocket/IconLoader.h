@@ -0,0 +1,54 @@
+#pragma once
+
+#include <Canvas.h>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+/// Loads app icons on background threads.
+///
+/// Icons are decoded straight to the requested size and stored in a
+/// thumbnail cache on disk, keyed by the icon path and modification time.
+class IconLoader {
+public:
+  struct Result {
+    std::string path;
+    std::optional<rmlib::MemoryCanvas> icon;
+  };
+
+  IconLoader(rmlib::Size iconSize, int threads = 2);
+  ~IconLoader();
+
+  IconLoader(const IconLoader&) = delete;
+  IconLoader& operator=(const IconLoader&) = delete;
+
+  /// Queues the icon at the given path, unless it's already pending.
+  void request(const std::string& path);
+
+  /// \returns All icons that finished loading since the last call.
+  std::vector<Result> takeResults();
+
+  bool hasPending() const;
+
+private:
+  void work();
+  std::optional<rmlib::MemoryCanvas> load(const std::string& path) const;
+
+  rmlib::Size iconSize;
+  std::string cacheDir;
+
+  mutable std::mutex mutex;
+  std::condition_variable cond;
+  std::deque<std::string> queue;
+  std::unordered_set<std::string> pending;
+  std::vector<Result> results;
+  bool stopping = false;
+
+  std::vector<std::thread> workers;
+};
@@ -1,4 +1,5 @@
 #include "App.h"
+#include "IconLoader.h"
 
 #include <csignal>
 #include <iostream>
@@ -17,6 +18,8 @@ namespace {
 
 constexpr auto config_path_suffix = ".config/rocket/config";
 
+constexpr auto icon_size = Size{ 128, 128 };
+
 std::vector<pid_t> stoppedChildren;
 std::function<void()> stopCallback;
 
@@ -66,7 +69,7 @@ public:
         doRefresh = true;
         this->markNeedsDraw();
         // TODO: why!!??
-        this->markNeedsLayout();
+        this->markSubtreeNeedsLayout();
       }
     } else if (this->widget->background != nullptr && wasVisible) {
       // Don't mark the children!
@@ -81,28 +84,28 @@ public:
   }
 
 protected:
-  UpdateRegion doDraw(rmlib::Rect rect, rmlib::Canvas& canvas) override {
+  UpdateRegion doDraw(rmlib::Rect rect, const PaintContext& ctx) override {
     if (!this->widget->child.has_value()) {
       if (this->widget->background != nullptr) {
         const auto offset =
           rect.align(this->widget->background->rect().size(), 0.5f, 0.5f)
             .topLeft;
-        copy(canvas,
-             offset,
-             *this->widget->background,
-             this->widget->background->rect());
+        ctx.drawImage(*this->widget->background, offset);
         return UpdateRegion{ rect };
       }
 
       return UpdateRegion{};
     }
 
-    auto result = this->child->draw(rect, canvas);
+    auto result = this->child->draw(rect, ctx);
     if (doRefresh) {
       doRefresh = false;
-      result.waveform = fb::Waveform::GC16;
-      result.flags = static_cast<fb::UpdateFlags>(fb::UpdateFlags::FullRefresh |
-                                                  fb::UpdateFlags::Sync);
+      // A single full refresh of everything that changed.
+      result = UpdateRegion{ result.bounds(),
+                             fb::Waveform::GC16,
+                             static_cast<fb::UpdateFlags>(
+                               fb::UpdateFlags::FullRefresh |
+                               fb::UpdateFlags::Sync) };
     }
     return result;
   }
@@ -175,7 +178,9 @@ public:
     const Canvas& canvas = app.description.iconImage.has_value()
                              ? app.description.iconImage->canvas
                              : missingImage.canvas;
-    return Container(GestureDetector(Column(Sized(Image(canvas), 128, 128),
+    return Container(GestureDetector(Column(Sized(Image(canvas),
+                                                  icon_size.width,
+                                                  icon_size.height),
                                             Text(app.description.name)),
                                      Gestures{}.OnTap(onLaunch)),
                      Insets::all(2),
@@ -208,7 +213,9 @@ public:
   void init(AppContext& context, const BuildContext&) {
     context.getInputManager().getBaseDevices()->key.grab();
 
-    fbCanvas = &context.getFbCanvas();
+    appContext = &context;
+    // Rocket draws into the framebuffer, so this has the screen of the apps.
+    fbCanvas = &context.getCanvas();
     touchDevice = &context.getInputManager().getBaseDevices()->touch;
 
     readApps(); // TODO: do this on turning visible
@@ -267,43 +274,50 @@ public:
   }
 
   auto runningApps() const {
-    std::vector<RunningAppWidget> widgets;
+    // Keyed by path, so starting or stopping an app doesn't redraw the others.
+    std::vector<Keyed<RunningAppWidget>> widgets;
     for (const auto& app : apps) {
       if (app.isRunning()) {
+        auto onTap = [this, &app] {
+          setState(
+            [&app](auto& self) { self.switchApp(*const_cast<App*>(&app)); });
+        };
+        auto onKill = [this, &app] {
+          setState([&app](auto& self) {
+            std::cout << "stopping " << app.description.name << std::endl;
+            const_cast<App*>(&app)->stop();
+            self.stopTimer();
+          });
+        };
         widgets.emplace_back(
-          app,
-          [this, &app] {
-            setState(
-              [&app](auto& self) { self.switchApp(*const_cast<App*>(&app)); });
-          },
-          [this, &app] {
-            setState([&app](auto& self) {
-              std::cout << "stopping " << app.description.name << std::endl;
-              const_cast<App*>(&app)->stop();
-              self.stopTimer();
-            });
-          },
-          app.description.path == currentAppPath);
+          app.description.path,
+          RunningAppWidget(app,
+                           std::move(onTap),
+                           std::move(onKill),
+                           app.description.path == currentAppPath));
       }
     }
     return Wrap(widgets);
   }
 
   auto appList() const {
-    std::vector<AppWidget> widgets;
+    std::vector<Keyed<AppWidget>> widgets;
     for (const auto& app : apps) {
       if (!app.isRunning()) {
-        widgets.emplace_back(app, [this, &app] {
+        auto onLaunch = [this, &app] {
           setState(
             [&app](auto& self) { self.switchApp(*const_cast<App*>(&app)); });
-        });
+        };
+        widgets.emplace_back(app.description.path,
+                             AppWidget(app, std::move(onLaunch)));
       }
     }
     return Wrap(widgets);
   }
 
   auto launcher(AppContext& context) const {
-    return Cleared(Column(header(context), runningApps(), appList()));
+    return Cleared(
+      Column(header(context), runningApps(), RepaintBoundary(appList())));
   }
 
   auto build(AppContext& context, const BuildContext&) const {
@@ -331,7 +345,9 @@ public:
   }
 
 private:
-  bool sleep() {
+  /// Blocks until the device wakes up again.
+  /// \returns True if the user woke it with the power button.
+  static bool sleep() {
     system("/sbin/rmmod brcmfmac");
     int res = system("echo \"mem\" > /sys/power/state");
     system("/sbin/modprobe brcmfmac");
@@ -364,25 +380,41 @@ private:
     sleepCountdown = time;
     sleepTimer = context.addTimer(
       std::chrono::seconds(time == 0 ? 0 : 1),
-      [this] { tick(); },
+      [this, &context] { tick(context); },
       std::chrono::seconds(1));
   }
 
-  void tick() const {
-    setState([](auto& self) {
+  void tick(AppContext& context) const {
+    setState([&context](auto& self) {
       self.sleepCountdown -= 1;
 
       if (self.sleepCountdown == -1) {
-        if (self.sleep()) {
-          // If the user pressed the button, stop the timer and return to the
-          // current app.
-          self.resetInactivity();
-          self.sleepTimer.disable();
-          self.hide(nullptr);
-        } else {
-          // Retry sleeping if failed or something else woke us.
-          self.sleepCountdown = retry_sleep_timeout;
-        }
+        // Suspend in the background, keep showing "Sleeping" until we wake.
+        self.sleepCountdown = 0;
+        self.sleepTimer.disable();
+        context.runAsync(self.sleepTask, &LauncherState::sleep)
+          .then([&self, &context](bool userWoke) {
+            self.wake(context, userWoke);
+          });
+      }
+    });
+  }
+
+  void wake(AppContext& context, bool userWoke) const {
+    setState([&context, userWoke](auto& self) {
+      // The timer was stopped in the meantime.
+      if (self.sleepCountdown != 0) {
+        return;
+      }
+
+      if (userWoke) {
+        // If the user pressed the button, return to the current app.
+        self.resetInactivity();
+        self.sleepCountdown = -1;
+        self.hide(nullptr);
+      } else {
+        // Retry sleeping if failed or something else woke us.
+        self.startTimer(context, retry_sleep_timeout);
       }
     });
   }
@@ -530,7 +562,10 @@ private:
         }
       } else {
 
-        // Update existing apps.
+        // Update existing apps, keeping the icon if it didn't change.
+        if (descIt->iconPath == appIt->description.iconPath) {
+          descIt->iconImage = std::move(appIt->description.iconImage);
+        }
         appIt->description = std::move(*descIt);
         appDescriptions.erase(descIt);
       }
@@ -546,6 +581,55 @@ private:
     std::sort(apps.begin(), apps.end(), [](const auto& app1, const auto& app2) {
       return app1.description.path < app2.description.path;
     });
+
+    requestIcons();
+  }
+
+  void requestIcons() {
+    for (const auto& app : apps) {
+      if (!app.description.iconImage.has_value() &&
+          !app.description.iconPath.empty()) {
+        iconLoader.request(app.description.iconPath);
+      }
+    }
+
+    // Poll for loaded icons, only while there are any pending.
+    if (!pollingIcons && iconLoader.hasPending() && appContext != nullptr) {
+      pollingIcons = true;
+      iconTimer = appContext->addTimer(
+        std::chrono::milliseconds(100),
+        [this] { updateIcons(); },
+        std::chrono::milliseconds(100));
+    }
+  }
+
+  void updateIcons() {
+    // Check this before taking the results, so none can be missed.
+    const auto done = !iconLoader.hasPending();
+    auto results = iconLoader.takeResults();
+
+    if (!results.empty()) {
+      setState([&results](auto& self) {
+        for (auto& result : results) {
+          if (!result.icon.has_value()) {
+            std::cerr << "error loading icon: " << result.path << std::endl;
+            continue;
+          }
+
+          for (auto& app : self.apps) {
+            if (app.description.iconPath == result.path &&
+                !app.description.iconImage.has_value()) {
+              app.description.iconImage.emplace(result.icon->canvas);
+            }
+          }
+        }
+      });
+    }
+
+    if (done) {
+      pollingIcons = false;
+      iconTimer.disable();
+    }
   }
 
   void resetInactivity() const {
@@ -557,8 +641,14 @@ private:
 
   std::optional<MemoryCanvas> backupBuffer;
 
+  IconLoader iconLoader{ icon_size };
+
   TimerHandle sleepTimer;
   TimerHandle inactivityTimer;
+  TimerHandle iconTimer;
+  TaskHandle sleepTask;
+
+  AppContext* appContext = nullptr;
 
   const Canvas* fbCanvas = nullptr;
   input::InputDeviceBase* touchDevice = nullptr;
@@ -566,6 +656,7 @@ private:
   int sleepCountdown = -1;
   mutable int inactivityCountdown = default_inactivity_timeout;
   bool visible = true;
+  bool pollingIcons = false;
 };
 
 LauncherState
@@ -150,7 +150,10 @@ protected:
     return { width, height };
   }
 
-  void drawKey(Canvas& canvas, Point pos, const Key& key, int keyWidth) {
+  void drawKey(const PaintContext& ctx,
+               Point pos,
+               const Key& key,
+               int keyWidth) {
     const auto frontLabelHeight = key.shift.empty() && key.alpha.empty()
                                     ? keyHeight
                                     : int(front_label_factor * keyHeight);
@@ -167,7 +170,7 @@ protected:
         upperLabelHeight + (frontLabelHeight - fontSizes.y) / 2;
       const auto position = pos + Point{ xOffset, yOffset };
 
-      canvas.drawText(key.front, position, fontSize);
+      ctx.drawText(key.front, position, fontSize);
     }
 
     // Draw alpha and 2nd label.
@@ -188,23 +191,29 @@ protected:
 
       const auto position = pos + Point{ xOffset, yOffset };
 
-      canvas.drawText(key.shift, position, fontSize, 0x55);
+      ctx.drawText(key.shift, position, fontSize, 0x55);
 
       if (!key.alpha.empty()) {
         const auto spacing =
           Canvas::getTextSize(std::string(key.shift) + " ", fontSize);
         const auto positonA = pos + Point{ xOffset + spacing.x, yOffset };
-        canvas.drawText(key.alpha, positonA, fontSize, 0xaa);
+        ctx.drawText(key.alpha, positonA, fontSize, 0xaa);
       }
     }
 
-    canvas.drawRectangle(
-      pos, pos + Point{ keyWidth - 1, keyHeight - 1 }, black);
+    ctx.drawRectangle(pos, pos + Point{ keyWidth - 1, keyHeight - 1 }, black);
   }
 
-  UpdateRegion doDraw(Rect rect, Canvas& canvas) final {
+  void moveBy(Point delta) final {
+    LeafRenderObject::moveBy(delta);
+    for (auto& [rect, _] : keyLocations) {
+      rect += delta;
+    }
+  }
+
+  UpdateRegion doDraw(Rect rect, const PaintContext& ctx) final {
     keyLocations.clear();
-    canvas.set(rect, white);
+    ctx.fill(rect, white);
 
     int y = rect.topLeft.y;
     for (const auto& row : keymap) {
@@ -221,7 +230,7 @@ protected:
         if (key.scancode != 0) {
           keyLocations.emplace_back(
             Rect{ { x, y }, { x + keyW - 1, y + keyHeight - 1 } }, &key);
-          drawKey(canvas, { x, y }, key, keyW);
+          drawKey(ctx, { x, y }, key, keyW);
         }
 
         x += keyW;
@@ -338,7 +347,7 @@ protected:
     return constraints.max;
   }
 
-  UpdateRegion doDraw(Rect rect, Canvas& canvas) final {
+  UpdateRegion doDraw(Rect rect, const PaintContext& ctx) final {
     if (widget->calc == nullptr) {
       return {};
     }
@@ -353,33 +362,37 @@ protected:
     }
 
     if (lcd->contrast == 0) {
-      canvas.set(rect, black);
+      ctx.fill(rect, black);
     } else {
       float inc_x = float(lcd->width) / rect.width();
       float inc_y = float(lcd->height) / rect.height();
 
-      const auto canvasStride = canvas.lineSize() / sizeof(uint16_t);
-      auto* canvasLinePtr =
-        canvas.getPtr<uint16_t>(rect.topLeft.x, rect.topLeft.y);
+      // Only scale the visible part.
+      const auto visible = ctx.clip();
+      const auto offset = ctx.offset();
 
-      float subY = 0;
-      for (int y = rect.topLeft.y; y <= rect.bottomRight.y; y++) {
-        const uint8_t* lcdRow = &lcd->data[int(subY) * lcd->rowstride];
-        auto* canvasPtr = canvasLinePtr;
+      ctx.canvas().visit([&](auto typedCanvas) {
+        using Pixel = typename decltype(typedCanvas)::value_type;
+        const auto on = static_cast<Pixel>(black);
+        const auto off = static_cast<Pixel>(white);
 
-        float subX = 0;
-        for (int x = rect.topLeft.x; x <= rect.bottomRight.x; x++) {
-          const uint8_t data = lcdRow[int(subX)];
-          const uint16_t pixel = data ? black : white;
+        float subY = float(visible.topLeft.y - rect.topLeft.y) * inc_y;
+        for (int y = visible.topLeft.y; y <= visible.bottomRight.y; y++) {
+          const uint8_t* lcdRow = &lcd->data[int(subY) * lcd->rowstride];
+          auto* canvasPtr =
+            typedCanvas.getRow(y + offset.y) + visible.topLeft.x + offset.x;
 
-          *canvasPtr = pixel;
+          float subX = float(visible.topLeft.x - rect.topLeft.x) * inc_x;
+          for (int x = visible.topLeft.x; x <= visible.bottomRight.x; x++) {
+            const uint8_t data = lcdRow[int(subX)];
+            *canvasPtr = data ? on : off;
 
-          subX += inc_x;
-          canvasPtr += 1;
+            subX += inc_x;
+            canvasPtr += 1;
+          }
+          subY += inc_y;
         }
-        subY += inc_y;
-        canvasLinePtr += canvasStride;
-      }
+      });
     }
     std::swap(lcd, oldLcd);
 
@@ -401,16 +414,14 @@ public:
   class State : public StateBase<DownloadDialog> {
   public:
     void init(AppContext& ctx, const BuildContext& buildCtx) {
-      startTimer = ctx.addTimer(std::chrono::seconds(0), [&] {
-        constexpr auto url =
-          "http://tiroms.weebly.com/uploads/1/1/0/5/110560031/ti84plus.rom";
-        auto cmd = "wget -O '" + getWidget().romPath + "' " + url;
-
-        std::cout << cmd << "\n";
-        system(cmd.c_str());
-
-        Navigator::of(buildCtx).pop();
-      });
+      constexpr auto url =
+        "http://tiroms.weebly.com/uploads/1/1/0/5/110560031/ti84plus.rom";
+      auto cmd = "wget -O '" + getWidget().romPath + "' " + url;
+      std::cout << cmd << "\n";
+
+      // Download in the background, so the dialog is drawn in the meantime.
+      ctx.runAsync(download, [cmd = std::move(cmd)] { system(cmd.c_str()); })
+        .then([&buildCtx] { Navigator::of(buildCtx).pop(); });
     }
 
     auto build(AppContext& appCtx, const BuildContext& ctx) const {
@@ -421,7 +432,7 @@ public:
     }
 
   private:
-    TimerHandle startTimer;
+    TaskHandle download;
   };
 
   DownloadDialog(std::string_view romPath) : romPath(romPath) {}
@@ -520,7 +531,9 @@ public:
     return Cleared(
       Center(Border(Column(header(context, width),
                            Sized(Screen(mCalc), width, height),
-                           Sized(Keypad(mCalc), width, std::nullopt)),
+                           Sized(RepaintBoundary(Keypad(mCalc)),
+                                 width,
+                                 std::nullopt)),
                     Insets::all(1))));
   }
 
@@ -613,7 +626,13 @@ int
 main(int argc, char* argv[]) {
   const auto* calc_name = argc > 1 ? argv[1] : calc_default_rom;
 
-  const auto err = runApp(Navigator(Calculator(calc_name)));
+  AppOptions options;
+  options.greyCanvas = true;
+  options.coalesceMoves = true;
+  // The calculator runs every 10ms, only draw at the screen's frame rate.
+  options.frameInterval = frame_time;
+
+  const auto err = runApp(Navigator(Calculator(calc_name)), options);
 
   if (err.isError()) {
     std::cerr << err.getError().msg << std::endl;
@@ -8,6 +8,7 @@
 
 #include <algorithm>
 #include <iostream>
+#include <utility>
 
 #ifdef __APPLE__
 #include "event-codes.h"
@@ -620,32 +621,82 @@ initMouseBuf(std::array<char, 6>& buf, Point loc) {
   buf = { esc_char, '[', 'M', 32, cx, cy };
 }
 
-// TODO: gesture progress updates, don't do multiple scrolls
+constexpr auto scroll_size = 4 * CELL_HEIGHT;
+
+// How far a fling keeps scrolling after the fingers are lifted.
+constexpr float fling_time = 0.25f;
+constexpr int max_fling_steps = 10;
+
+/// Sends scroll steps to the terminal, negative steps scroll up.
 void
-handleGesture(Keyboard& kb, const SwipeGesture& gesture) {
-  if (gesture.fingers != 2) {
+sendScroll(Keyboard& kb, Point position, int steps) {
+  if (steps == 0) {
     return;
   }
 
   std::array<char, 6> buf;
-  const auto loc = gesture.startPosition - kb.screenRect.topLeft;
-  initMouseBuf(buf, loc);
+  initMouseBuf(buf, position - kb.screenRect.topLeft);
+
+  // Fingers moving up scroll the content down, like a touch screen.
+  buf[3] += steps > 0 ? 64 + 0 : 64 + 1;
+  for (int i = 0; i < std::abs(steps); i++) {
+    write(kb.term->fd, buf.data(), buf.size());
+  }
+}
 
-  constexpr auto scroll_size = 4 * CELL_HEIGHT;
-  const auto distance = std::max(
-    1, abs(gesture.endPosition.y - gesture.startPosition.y) / scroll_size);
+int
+getScrollSteps(const SwipeGesture& gesture, Point position) {
+  return (position.y - gesture.startPosition.y) / scroll_size;
+}
 
-  if (gesture.direction == rmlib::input::SwipeGesture::Up) {
-    buf[3] += 64 + 1;
-    for (int i = 0; i < distance; i++) {
-      write(kb.term->fd, buf.data(), buf.size());
-    }
-  } else if (gesture.direction == rmlib::input::SwipeGesture::Down) {
-    buf[3] += 64 + 0;
-    for (int i = 0; i < distance; i++) {
-      write(kb.term->fd, buf.data(), buf.size());
-    }
+/// Scrolls while a two finger swipe is in progress, so the scrollback follows
+/// the fingers. At most one write per step of movement.
+void
+handleGestureProgress(Keyboard& kb) {
+  const auto* gesture = kb.gestureCtrlr.getStartedGesture();
+  const auto* swipe =
+    gesture != nullptr ? std::get_if<SwipeGesture>(gesture) : nullptr;
+  if (swipe == nullptr || swipe->fingers != 2 ||
+      (swipe->direction != SwipeGesture::Up &&
+       swipe->direction != SwipeGesture::Down)) {
+    return;
+  }
+
+  const auto& progress = kb.gestureCtrlr.getProgress();
+  if (progress.fingers != 2) {
+    return;
+  }
+
+  const auto steps = getScrollSteps(*swipe, progress.centroid);
+  sendScroll(kb, swipe->startPosition, steps - kb.scrollSteps);
+  kb.scrollSteps = steps;
+  kb.scrollCentroid = progress.centroid;
+}
+
+void
+handleGesture(Keyboard& kb, const SwipeGesture& gesture) {
+  const auto sentSteps = std::exchange(kb.scrollSteps, 0);
+  const auto centroid = std::exchange(kb.scrollCentroid, std::nullopt);
+  if (gesture.fingers != 2 || (gesture.direction != SwipeGesture::Up &&
+                               gesture.direction != SwipeGesture::Down)) {
+    return;
+  }
+
+  // The end position is that of the last finger lifted, which is off by half
+  // the spread of the fingers. Continue from the centroid used for progress.
+  auto steps = getScrollSteps(gesture, centroid.value_or(gesture.endPosition));
+  if (steps == 0 && sentSteps == 0) {
+    // Always scroll at least once per swipe.
+    steps = gesture.direction == SwipeGesture::Up ? -1 : 1;
   }
+
+  // Keep scrolling for a bit when the fingers were lifted while moving.
+  const auto flingSteps =
+    std::clamp(int(gesture.velocityY * fling_time / scroll_size),
+               -max_fling_steps,
+               max_fling_steps);
+
+  sendScroll(kb, gesture.startPosition, steps + flingSteps - sentSteps);
 }
 
 template<typename Event>
@@ -658,11 +709,13 @@ handleScreenEvent(Keyboard& kb, const Event& ev) {
   const auto lastFingers = kb.gestureCtrlr.getCurrentFingers();
 
   if constexpr (std::is_same_v<Event, TouchEvent>) {
-    const auto [gestures, _] = kb.gestureCtrlr.handleEvents({ ev });
-    for (const auto& gesture : gestures) {
-      if (std::holds_alternative<SwipeGesture>(gesture)) {
-        handleGesture(kb, std::get<SwipeGesture>(gesture));
+    const auto gesture = kb.gestureCtrlr.handleEvent(ev);
+    if (gesture.has_value()) {
+      if (std::holds_alternative<SwipeGesture>(*gesture)) {
+        handleGesture(kb, std::get<SwipeGesture>(*gesture));
       }
+    } else {
+      handleGestureProgress(kb);
     }
   }
 
@@ -5,6 +5,7 @@
 #include <Input.h>
 
 #include <chrono>
+#include <optional>
 
 constexpr int row_size = 11;
 constexpr int num_rows = 6;
@@ -85,6 +86,11 @@ struct Keyboard {
 
   rmlib::input::InputManager input;
   rmlib::input::GestureController gestureCtrlr;
+
+  // Scroll steps sent during the current swipe.
+  int scrollSteps = 0;
+  // Centroid of the fingers when the steps were last sent.
+  std::optional<rmlib::Point> scrollCentroid;
   rmlib::fb::FrameBuffer* fb;
   terminal_t* term;
 
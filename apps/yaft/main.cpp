@@ -246,6 +246,36 @@ main(int argc, const char* argv[]) {
 
   keyboard.draw();
 
+  if (keyboard.input
+        .addFd(term.fd,
+               [&] {
+                 if ((size = read(term.fd, buf, BUFSIZE)) > 0) {
+                   if (VERBOSE)
+                     ewrite(STDOUT_FILENO, buf, size);
+                   parse(&term, buf, size);
+                   if (LAZY_DRAW && size == BUFSIZE)
+                     return; /* maybe more data arrives soon */
+                   refresh(*fb, &term);
+                 }
+               })
+        .isError()) {
+    logging(FATAL, "Watching the pty failed\n");
+    goto tty_init_failed;
+  }
+
+  if constexpr (USE_STDIN) {
+    if (keyboard.input
+          .addFd(STDIN_FILENO,
+                 [&] {
+                   if ((size = read(STDIN_FILENO, buf, BUFSIZE)) > 0)
+                     ewrite(term.fd, buf, size);
+                 })
+          .isError()) {
+      logging(FATAL, "Watching stdin failed\n");
+      goto tty_init_failed;
+    }
+  }
+
   /* main loop */
   while (child_alive) {
     if (need_redraw) {
@@ -254,44 +284,18 @@ main(int argc, const char* argv[]) {
       refresh(*fb, &term);
     }
 
-    auto eventAndFds = [&] {
-      if constexpr (USE_STDIN) {
-        return keyboard.input.waitForInput(
-          select_timeout, term.fd, STDIN_FILENO);
-      } else {
-        return keyboard.input.waitForInput(select_timeout, term.fd);
-      }
-    }();
+    // The pty and stdin are handled by the callbacks above.
+    auto events = keyboard.input.waitForInput(select_timeout);
 
     // Update repeat in any case (timeout, error or events).
     keyboard.updateRepeat();
 
-    if (eventAndFds.isError()) {
-      std::cerr << "Error reading input: " << eventAndFds.getError().msg
-                << "\n";
+    if (events.isError()) {
+      std::cerr << "Error reading input: " << events.getError().msg << "\n";
       continue;
     }
 
-    const auto& [events, fds] = *eventAndFds;
-    keyboard.handleEvents(events);
-
-    if (fds[0]) {
-      if ((size = read(term.fd, buf, BUFSIZE)) > 0) {
-        if (VERBOSE)
-          ewrite(STDOUT_FILENO, buf, size);
-        parse(&term, buf, size);
-        if (LAZY_DRAW && size == BUFSIZE)
-          continue; /* maybe more data arrives soon */
-        refresh(*fb, &term);
-      }
-    }
-
-    if constexpr (USE_STDIN) {
-      if (fds[1]) {
-        if ((size = read(STDIN_FILENO, buf, BUFSIZE)) > 0)
-          ewrite(term.fd, buf, size);
-      }
-    }
+    keyboard.handleEvents(*events);
   }
 
   /* normal exit */
@@ -6,6 +6,7 @@
 #define STB_TRUETYPE_IMPLEMENTATION
 #include "stb_truetype.h"
 
+#include <algorithm>
 #include <array>
 #include <codecvt>
 #include <iostream>
@@ -21,11 +22,6 @@ blend(uint8_t factor, uint8_t fg, uint8_t bg) {
   return uint8_t(val);
 }
 
-constexpr uint16_t
-toRGB565(uint8_t grey) {
-  return (grey >> 3) | ((grey >> 2) << 5) | ((grey >> 3) << 11);
-}
-
 #ifdef EMULATE
 #ifdef __APPLE__
 constexpr auto font_path = "/System/Library/Fonts/SFNSMono.ttf";
@@ -222,26 +218,25 @@ Canvas::drawText(std::string_view text,
     const auto bg8 = bg & 0xff;
 
     // Draw the bitmap to canvas.
-    for (int y = 0; y < h; y++) {
-      for (int x = 0; x < w; x++) {
-        auto t = textBuffer[y * w + x];
-        // int pixel = bg8 + (t * (fg8 - bg8)) / 0xff;
-        auto pixel = blend(t, fg8, bg8);
-        // auto pixel = (0xff - textBuffer[y * w + x]);
-        uint16_t pixel565 = toRGB565(pixel);
-        // (pixel >> 3) | ((pixel >> 2) << 5) | ((pixel >> 3) << 11);
-
-        auto memY = location.y + static_cast<int>(baseLine) + y0 + y /*- 1*/;
-        auto memX = location.x + static_cast<int>(xpos) + x0 + x;
-        if (memX < clipRect.topLeft.x || clipRect.bottomRight.x < memX ||
-            memY < clipRect.topLeft.y || clipRect.bottomRight.y < memY) {
-          continue;
+    visit([&](auto canvas) {
+      using Format = typename decltype(canvas)::format;
+
+      for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) {
+          auto t = textBuffer[y * w + x];
+          auto pixel = blend(t, fg8, bg8);
+
+          auto memY = location.y + static_cast<int>(baseLine) + y0 + y;
+          auto memX = location.x + static_cast<int>(xpos) + x0 + x;
+          if (memX < clipRect.topLeft.x || clipRect.bottomRight.x < memX ||
+              memY < clipRect.topLeft.y || clipRect.bottomRight.y < memY) {
+            continue;
+          }
+
+          canvas.getRow(memY)[memX] = Format::fromGrey(pixel);
         }
-
-        auto* targetPtr = getPtr<uint16_t>(memX, memY);
-        *targetPtr = pixel565;
       }
-    }
+    });
 
     // note that this stomps the old data, so where character boxes overlap
     // (e.g. 'lj') it's wrong because this API is really for baking character
@@ -258,7 +253,23 @@ Canvas::drawText(std::string_view text,
 }
 
 void
-Canvas::drawLine(Point start, Point end, int val) {
+Canvas::drawLine(Point start, Point end, int val, int thickness) {
+  // Straight lines are just rectangles.
+  const auto before = (thickness - 1) / 2;
+  const auto after = thickness / 2;
+  if (start.y == end.y) {
+    fill({ { std::min(start.x, end.x), start.y - before },
+           { std::max(start.x, end.x), start.y + after } },
+         val);
+    return;
+  }
+  if (start.x == end.x) {
+    fill({ { start.x - before, std::min(start.y, end.y) },
+           { start.x + after, std::max(start.y, end.y) } },
+         val);
+    return;
+  }
+
   int dx = abs(end.x - start.x);
   int sx = start.x < end.x ? 1 : -1;
 
@@ -267,8 +278,19 @@ Canvas::drawLine(Point start, Point end, int val) {
 
   int err = (dx > dy ? dx : -dy) / 2;
 
+  // Thick lines are drawn as a span across the major axis for every point.
+  const auto span = dx > dy ? Rect{ { 0, -before }, { 0, after } }
+                            : Rect{ { -before, 0 }, { after, 0 } };
+
   for (;;) {
-    setPixel(start, val);
+    if (thickness == 1) {
+      if (rect().contains(start)) {
+        setPixel(start, val);
+      }
+    } else {
+      fill(span + start, val);
+    }
+
     if (start == end) {
       break;
     }
@@ -285,6 +307,88 @@ Canvas::drawLine(Point start, Point end, int val) {
   }
 }
 
+void
+Canvas::drawLineAA(Point start, Point end, int val) {
+  const auto canvasRect = rect();
+  rasterizeLineAA(start, end, [&](Point p, uint8_t coverage) {
+    if (!canvasRect.contains(p)) {
+      return;
+    }
+
+    const auto old = getPixel(p.x, p.y);
+    if (mComponents == 2) {
+      const auto grey = blend(
+        coverage, rgb565ToGrey(uint16_t(val)), rgb565ToGrey(uint16_t(old)));
+      setPixel(p, greyToRGB565(grey));
+      return;
+    }
+
+    int result = 0;
+    for (int i = 0; i < mComponents; i++) {
+      const auto shift = i * 8;
+      result |= blend(coverage, (val >> shift) & 0xff, (old >> shift) & 0xff)
+                << shift;
+    }
+    setPixel(p, result);
+  });
+}
+
+namespace {
+
+/// Returns how many pixels the row `i` rows away from the top or bottom edge
+/// of a rect with rounded corners is inset.
+int
+cornerInset(int i, int radius) {
+  if (i >= radius) {
+    return 0;
+  }
+
+  const auto dy = float(radius - i) - 0.5f;
+  const auto dx = std::sqrt(float(radius * radius) - dy * dy);
+  return radius - static_cast<int>(std::lround(dx));
+}
+
+} // namespace
+
+void
+Canvas::fillRoundedRectangle(Rect r, int radius, int val) {
+  radius = std::clamp(radius, 0, std::min(r.width(), r.height()) / 2);
+
+  for (int y = r.topLeft.y; y <= r.bottomRight.y; y++) {
+    const auto i = std::min(y - r.topLeft.y, r.bottomRight.y - y);
+    const auto inset = cornerInset(i, radius);
+    fill({ { r.topLeft.x + inset, y }, { r.bottomRight.x - inset, y } }, val);
+  }
+}
+
+void
+Canvas::drawRoundedRectangle(Rect r, int radius, int val, int thickness) {
+  radius = std::clamp(radius, 0, std::min(r.width(), r.height()) / 2);
+
+  const auto inner = Rect{ r.topLeft + Point{ thickness, thickness },
+                           r.bottomRight - Point{ thickness, thickness } };
+  const auto innerRadius = std::max(0, radius - thickness);
+
+  for (int y = r.topLeft.y; y <= r.bottomRight.y; y++) {
+    const auto i = std::min(y - r.topLeft.y, r.bottomRight.y - y);
+    const auto inset = cornerInset(i, radius);
+    const auto left = r.topLeft.x + inset;
+    const auto right = r.bottomRight.x - inset;
+
+    if (y < inner.topLeft.y || y > inner.bottomRight.y ||
+        inner.width() <= 0) {
+      fill({ { left, y }, { right, y } }, val);
+      continue;
+    }
+
+    // Only draw the parts outside the inner rounded rect.
+    const auto innerI = std::min(y - inner.topLeft.y, inner.bottomRight.y - y);
+    const auto innerInset = cornerInset(innerI, innerRadius);
+    fill({ { left, y }, { inner.topLeft.x + innerInset - 1, y } }, val);
+    fill({ { inner.bottomRight.x - innerInset + 1, y }, { right, y } }, val);
+  }
+}
+
 constexpr uint16_t
 greyAlphaToRGB565(uint8_t background, uint16_t pixel) {
   uint8_t grey = pixel & 0xff;
@@ -292,7 +396,7 @@ greyAlphaToRGB565(uint8_t background, uint16_t pixel) {
 
   auto blended = blend(alpha, grey, background);
 
-  return toRGB565(blended);
+  return greyToRGB565(blended);
 }
 
 std::optional<ImageCanvas>
@@ -312,6 +416,47 @@ ImageCanvas::load(const char* path, int background) {
   return ImageCanvas{ result };
 }
 
+std::optional<ImageCanvas>
+ImageCanvas::load(const char* path, Size maxSize, int background) {
+  int width;
+  int height;
+  int imgComponents;
+  auto* mem = stbi_load(path, &width, &height, &imgComponents, 2);
+  if (mem == nullptr) {
+    return std::nullopt;
+  }
+
+  const auto ceilDiv = [](int a, int b) { return (a + b - 1) / b; };
+  const auto factor = std::max({ 1,
+                                 ceilDiv(width, maxSize.width),
+                                 ceilDiv(height, maxSize.height) });
+
+  const auto newWidth = std::max(1, width / factor);
+  const auto newHeight = std::max(1, height / factor);
+
+  // Average each factor x factor box into a single pixel. This can be done in
+  // place, as each box starts at or after the pixel it's written to.
+  auto* pixels = reinterpret_cast<uint16_t*>(mem);
+  for (int y = 0; y < newHeight; y++) {
+    for (int x = 0; x < newWidth; x++) {
+      int sum = 0;
+      int count = 0;
+      for (int by = y * factor; by < std::min(height, (y + 1) * factor); by++) {
+        for (int bx = x * factor; bx < std::min(width, (x + 1) * factor);
+             bx++) {
+          const auto pixel = pixels[by * width + bx];
+          sum += blend(pixel >> 8, pixel & 0xff, background & 0xff);
+          count++;
+        }
+      }
+
+      pixels[y * newWidth + x] = greyToRGB565(sum / count);
+    }
+  }
+
+  return ImageCanvas{ Canvas(mem, newWidth, newHeight, 2) };
+}
+
 std::optional<ImageCanvas>
 ImageCanvas::load(uint8_t* data, int size, int background) {
   int width;
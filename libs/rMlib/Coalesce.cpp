@@ -0,0 +1,48 @@
+#include "Input.h"
+
+namespace rmlib::input {
+
+std::size_t
+coalesceMoves(std::vector<Event>& events, std::size_t begin) {
+  // Walk backwards, so the latest move of a slot is seen first. Bit i is set
+  // if slot i has a later move, without a down or up in between.
+  uint32_t touchMoveAfter = 0;
+  bool penMoveAfter = false;
+
+  auto kept = events.size();
+  for (auto i = events.size(); i-- > begin;) {
+    bool drop = false;
+
+    if (const auto* touch = std::get_if<TouchEvent>(&events[i])) {
+      if (touch->slot >= 0 && touch->slot < max_num_slots) {
+        const auto bit = 1U << touch->slot;
+        if (touch->isMove()) {
+          drop = (touchMoveAfter & bit) != 0;
+          touchMoveAfter |= bit;
+        } else {
+          touchMoveAfter &= ~bit;
+        }
+      }
+    } else if (const auto* pen = std::get_if<PenEvent>(&events[i])) {
+      if (pen->isMove()) {
+        drop = penMoveAfter;
+        penMoveAfter = true;
+      } else {
+        penMoveAfter = false;
+      }
+    }
+
+    if (!drop) {
+      kept--;
+      if (kept != i) {
+        events[kept] = events[i];
+      }
+    }
+  }
+
+  const auto dropped = kept - begin;
+  events.erase(events.begin() + begin, events.begin() + kept);
+  return dropped;
+}
+
+} // namespace rmlib::input
@@ -0,0 +1,182 @@
+#include "Dither.h"
+
+#include <algorithm>
+#include <array>
+#include <vector>
+
+namespace rmlib {
+
+namespace {
+
+/// How the lookup tables are indexed for a pixel format. The grey value of
+/// the pixel by default.
+template<typename Format>
+struct LutIndex {
+  static constexpr int size = 256;
+
+  static int of(typename Format::value_type pixel) {
+    return Format::toGrey(pixel);
+  }
+  static int toGrey(int index) { return index; }
+};
+
+/// Only the green channel is used to get the grey value, which has 6 bits.
+template<>
+struct LutIndex<pixel::RGB565> {
+  static constexpr int size = 64;
+
+  static int of(uint16_t pixel) { return (pixel >> 5) & 0x3f; }
+  static int toGrey(int index) { return rgb565ToGrey(uint16_t(index << 5)); }
+};
+
+template<typename Format>
+using LevelLut =
+  std::array<typename Format::value_type, LutIndex<Format>::size>;
+
+constexpr std::array<std::array<uint8_t, 4>, 4> bayer_matrix = { {
+  { 0, 8, 2, 10 },
+  { 12, 4, 14, 6 },
+  { 3, 11, 1, 9 },
+  { 15, 7, 13, 5 },
+} };
+
+constexpr uint8_t
+levelToGrey(int level, int levels) {
+  return uint8_t(level * 0xff / (levels - 1));
+}
+
+constexpr int
+nearestLevel(int grey, int levels) {
+  return (grey * (levels - 1) + 0x7f) / 0xff;
+}
+
+/// Maps the lookup index of a pixel to the quantized pixel, for a given
+/// threshold between 0 and 0xff.
+template<typename Format>
+LevelLut<Format>
+makeLut(int levels, int threshold) {
+  LevelLut<Format> result{};
+  for (int i = 0; i < LutIndex<Format>::size; i++) {
+    const int grey = LutIndex<Format>::toGrey(i);
+    const int level = (grey * (levels - 1) + threshold) / 0xff;
+    result[i] = Format::fromGrey(levelToGrey(level, levels));
+  }
+  return result;
+}
+
+template<typename Format>
+void
+quantizeNearest(BasicCanvas<Format> canvas, Rect region, int levels) {
+  using Pixel = typename Format::value_type;
+  const auto lut = makeLut<Format>(levels, 0x7f);
+
+  for (int y = region.topLeft.y; y <= region.bottomRight.y; y++) {
+    auto* row = canvas.getRow(y) + region.topLeft.x;
+    std::transform(row, row + region.width(), row, [&lut](Pixel pixel) {
+      return lut[LutIndex<Format>::of(pixel)];
+    });
+  }
+}
+
+template<typename Format>
+void
+quantizeBayer(BasicCanvas<Format> canvas, Rect region, int levels) {
+  using Index = LutIndex<Format>;
+
+  // One lookup table per matrix entry, so the inner loop only does a load
+  // per pixel. The threshold is centered in each of the 16 buckets.
+  std::array<LevelLut<Format>, 16> luts;
+  for (int i = 0; i < 16; i++) {
+    luts[i] = makeLut<Format>(levels, (2 * i + 1) * 0xff / 32);
+  }
+
+  for (int y = region.topLeft.y; y <= region.bottomRight.y; y++) {
+    auto* row = canvas.getRow(y) + region.topLeft.x;
+    const auto& matrixRow = bayer_matrix[y & 3];
+
+    // Pick the tables for this row once, aligned to the canvas so adjacent
+    // regions line up.
+    std::array<const LevelLut<Format>*, 4> rowLuts;
+    for (int i = 0; i < 4; i++) {
+      rowLuts[i] = &luts[matrixRow[(region.topLeft.x + i) & 3]];
+    }
+
+    const int width = region.width();
+    int x = 0;
+    for (; x + 4 <= width; x += 4) {
+      row[x + 0] = (*rowLuts[0])[Index::of(row[x + 0])];
+      row[x + 1] = (*rowLuts[1])[Index::of(row[x + 1])];
+      row[x + 2] = (*rowLuts[2])[Index::of(row[x + 2])];
+      row[x + 3] = (*rowLuts[3])[Index::of(row[x + 3])];
+    }
+    for (; x < width; x++) {
+      row[x] = (*rowLuts[x & 3])[Index::of(row[x])];
+    }
+  }
+}
+
+template<typename Format>
+void
+quantizeErrorDiffusion(BasicCanvas<Format> canvas, Rect region, int levels) {
+  const int width = region.width();
+
+  // Error of the current and next row, with a pixel of padding on each side
+  // so the kernel doesn't need bounds checks. Stored in 1/16ths.
+  std::vector<int> current(width + 2, 0);
+  std::vector<int> next(width + 2, 0);
+
+  for (int y = region.topLeft.y; y <= region.bottomRight.y; y++) {
+    auto* row = canvas.getRow(y) + region.topLeft.x;
+
+    // Serpentine scanning, to avoid the error drifting in one direction.
+    const bool reverse = ((y - region.topLeft.y) & 1) != 0;
+    const int dir = reverse ? -1 : 1;
+
+    for (int i = 0; i < width; i++) {
+      const int x = reverse ? width - 1 - i : i;
+      const int e = x + 1;
+
+      const int grey =
+        std::clamp(int(Format::toGrey(row[x])) + current[e] / 16, 0, 0xff);
+      const auto quantized = levelToGrey(nearestLevel(grey, levels), levels);
+      row[x] = Format::fromGrey(quantized);
+
+      const int error = grey - quantized;
+      current[e + dir] += error * 7;
+      next[e - dir] += error * 3;
+      next[e] += error * 5;
+      next[e + dir] += error * 1;
+    }
+
+    std::swap(current, next);
+    std::fill(next.begin(), next.end(), 0);
+  }
+}
+
+} // namespace
+
+void
+quantize(Canvas& canvas, Rect region, int levels, Dither dither) {
+  assert(levels >= 2);
+
+  region = region & canvas.rect();
+  if (region.width() <= 0 || region.height() <= 0) {
+    return;
+  }
+
+  canvas.visit([&](auto typed) {
+    switch (dither) {
+      case Dither::None:
+        quantizeNearest(typed, region, levels);
+        break;
+      case Dither::Bayer:
+        quantizeBayer(typed, region, levels);
+        break;
+      case Dither::ErrorDiffusion:
+        quantizeErrorDiffusion(typed, region, levels);
+        break;
+    }
+  });
+}
+
+} // namespace rmlib
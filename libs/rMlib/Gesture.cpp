@@ -1,5 +1,6 @@
 #include "Input.h"
 
+#include <cmath>
 #include <iostream>
 
 #ifndef __APPLE__
@@ -20,62 +21,178 @@ getSwipeDirection(Point delta) {
 }
 
 PinchGesture::Direction
-getPinchDirection() {
-  // TODO
-  return PinchGesture::In;
+getPinchDirection(float scale) {
+  return scale < 1 ? PinchGesture::In : PinchGesture::Out;
 }
 
+float
+distance(Point a, Point b) {
+  return std::hypot(float(a.x - b.x), float(a.y - b.y));
+}
+
+/// Wraps an angle difference to [-pi, pi].
+float
+wrapAngle(float angle) {
+  constexpr auto pi = float(M_PI);
+  while (angle > pi) {
+    angle -= 2 * pi;
+  }
+  while (angle < -pi) {
+    angle += 2 * pi;
+  }
+  return angle;
+}
+
+// Weight of the newest sample in the velocity, lower is smoother.
+constexpr float velocity_smoothing = 0.6f;
+
+// Fingers closer than this to the centroid don't have a meaningful angle.
+constexpr float min_rotation_radius = 20;
+
+// Without movement for this long the fingers are considered to be resting.
+constexpr auto fling_timeout = std::chrono::milliseconds(50);
+
 } // namespace
 
 Gesture
 GestureController::getGesture(Point currentDelta) {
-  const auto [avgStart, delta] = [this] {
-    std::vector<Point> delta;
-    Point avgStart;
-    int nActive = 0;
+  Point avgStart;
+  Point avgCurrent;
+  int nActive = 0;
 
 #ifndef NDEBUG
-    std::cout << "- delta: ";
+  std::cout << "- delta: ";
 #endif
 
-    for (const auto& slot : slots) {
-      if (slot.active) {
-        delta.push_back(slot.currentPos - slot.startPos);
-
+  for (const auto& slot : slots) {
+    if (slot.active) {
 #ifndef NDEBUG
-        std::cout << delta.back() << " ";
+      std::cout << slot.currentPos - slot.startPos << " ";
 #endif
 
-        avgStart += slot.startPos;
-        nActive++;
-      }
+      avgStart += slot.startPos;
+      avgCurrent += slot.currentPos;
+      nActive++;
     }
+  }
 
 #ifndef NDEBUG
-    std::cout << std::endl;
+  std::cout << std::endl;
 #endif
 
-    avgStart /= nActive;
-    return std::make_pair(avgStart, std::move(delta));
-  }();
-
-  const auto isSwipe =
-    std::all_of(
-      delta.cbegin(), delta.cend(), [](auto& p) { return p.x >= 0; }) ||
-    std::all_of(
-      delta.cbegin(), delta.cend(), [](auto& p) { return p.x <= 0; }) ||
-    std::all_of(
-      delta.cbegin(), delta.cend(), [](auto& p) { return p.y >= 0; }) ||
-    std::all_of(delta.cbegin(), delta.cend(), [](auto& p) { return p.y <= 0; });
+  avgStart /= nActive;
+  avgCurrent /= nActive;
+
+  // A pinch changes the distance between the fingers more than it moves
+  // their center.
+  float startSpread = 0;
+  float currentSpread = 0;
+  for (const auto& slot : slots) {
+    if (slot.active) {
+      startSpread += distance(slot.startPos, avgStart);
+      currentSpread += distance(slot.currentPos, avgCurrent);
+    }
+  }
+  startSpread /= float(nActive);
+  currentSpread /= float(nActive);
 
-  if (isSwipe) {
+  const auto spreadChange = std::abs(currentSpread - startSpread);
+  if (spreadChange <= distance(avgCurrent, avgStart)) {
     return SwipeGesture{ getSwipeDirection(currentDelta),
                          avgStart,
                          /* endPos */ {},
                          getCurrentFingers() };
   }
 
-  return PinchGesture{ getPinchDirection(), avgStart, getCurrentFingers() };
+  const auto scale = startSpread > 0 ? currentSpread / startSpread : 1.f;
+  return PinchGesture{
+    getPinchDirection(scale), avgStart, getCurrentFingers(), scale
+  };
+}
+
+void
+GestureController::updateProgress() {
+  dirty = false;
+
+  Point sum;
+  int fingers = 0;
+  for (const auto& slot : slots) {
+    if (slot.active) {
+      sum += slot.currentPos;
+      fingers++;
+    }
+  }
+
+  if (fingers == 0) {
+    progress.fingers = 0;
+    return;
+  }
+
+  const auto centroid = sum / fingers;
+  float spread = 0;
+  for (const auto& slot : slots) {
+    if (slot.active) {
+      spread += distance(slot.currentPos, centroid);
+    }
+  }
+  spread /= float(fingers);
+
+  if (fingers != baseFingers) {
+    // Start a new baseline, keeping the scale and rotation so far.
+    for (auto& slot : slots) {
+      slot.basePos = slot.currentPos;
+    }
+    baseFingers = fingers;
+    baseCentroid = centroid;
+    baseSpread = spread;
+    baseScale = progress.scale;
+    baseRotation = progress.rotation;
+
+    progress.fingers = fingers;
+    progress.centroid = centroid;
+    progress.spread = spread;
+    lastUpdate = reportTime;
+    return;
+  }
+
+  if (baseSpread > 0) {
+    progress.scale = baseScale * spread / baseSpread;
+  }
+
+  float rotation = 0;
+  int rotating = 0;
+  for (const auto& slot : slots) {
+    if (!slot.active) {
+      continue;
+    }
+    const auto base = slot.basePos - baseCentroid;
+    const auto current = slot.currentPos - centroid;
+    if (distance(slot.basePos, baseCentroid) < min_rotation_radius ||
+        distance(slot.currentPos, centroid) < min_rotation_radius) {
+      continue;
+    }
+    rotation += wrapAngle(std::atan2(float(current.y), float(current.x)) -
+                          std::atan2(float(base.y), float(base.x)));
+    rotating++;
+  }
+  if (rotating > 0) {
+    progress.rotation = baseRotation + rotation / float(rotating);
+  }
+
+  const auto dt = std::chrono::duration<float>(reportTime - lastUpdate).count();
+  if (dt > 0) {
+    const auto delta = centroid - progress.centroid;
+    progress.velocityX =
+      velocity_smoothing * (float(delta.x) / dt) +
+      (1 - velocity_smoothing) * progress.velocityX;
+    progress.velocityY =
+      velocity_smoothing * (float(delta.y) / dt) +
+      (1 - velocity_smoothing) * progress.velocityY;
+    lastUpdate = reportTime;
+  }
+
+  progress.centroid = centroid;
+  progress.spread = spread;
 }
 
 void
@@ -88,7 +205,8 @@ GestureController::handleTouchDown(const TouchEvent& event) {
 
   slot.currentPos = event.location;
   slot.startPos = event.location;
-  slot.time = std::chrono::steady_clock::now();
+  slot.time = event.time;
+  dirty = true;
 
   tapFingers = getCurrentFingers();
 }
@@ -97,8 +215,19 @@ std::optional<Gesture>
 GestureController::handleTouchUp(const TouchEvent& event) {
   std::optional<Gesture> result;
 
+  // Include the last movement of the finger in the velocity.
+  if (dirty) {
+    updateProgress();
+  }
+  if (event.time - lastUpdate > fling_timeout) {
+    // The fingers rested before being lifted.
+    progress.velocityX = 0;
+    progress.velocityY = 0;
+  }
+
   auto& slot = slots.at(event.slot);
   slot.active = false;
+  dirty = true;
 
   std::cerr << "Touch up, current fingers: " << getCurrentFingers()
             << std::endl;
@@ -111,8 +240,13 @@ GestureController::handleTouchUp(const TouchEvent& event) {
       result = TapGesture{ tapFingers, slot.startPos };
       //}
     } else {
-      if (std::holds_alternative<SwipeGesture>(gesture)) {
-        std::get<SwipeGesture>(gesture).endPosition = event.location;
+      if (auto* swipe = std::get_if<SwipeGesture>(&gesture)) {
+        swipe->endPosition = event.location;
+        swipe->velocityX = progress.velocityX;
+        swipe->velocityY = progress.velocityY;
+      } else if (auto* pinch = std::get_if<PinchGesture>(&gesture)) {
+        pinch->direction = getPinchDirection(progress.scale);
+        pinch->scale = progress.scale;
       }
       result = gesture;
     }
@@ -127,6 +261,7 @@ void
 GestureController::handleTouchMove(const TouchEvent& event) {
   auto& slot = slots.at(event.slot);
   slot.currentPos = event.location;
+  dirty = true;
   auto delta = event.location - slot.startPos;
 
   if (!started) {
@@ -140,7 +275,30 @@ GestureController::handleTouchMove(const TouchEvent& event) {
     return;
   }
 
-  // Started, calc percentage (TODO)
+  // Started, the progress is available through `getProgress`.
+}
+
+std::optional<Gesture>
+GestureController::handleEvent(const TouchEvent& event) {
+  // All events of a report share the kernel timestamp, so a new timestamp
+  // means the previous report is complete.
+  if (dirty && event.time != reportTime) {
+    updateProgress();
+  }
+  reportTime = event.time;
+
+  switch (event.type) {
+    case TouchEvent::Down:
+      handleTouchDown(event);
+      break;
+    case TouchEvent::Move:
+      handleTouchMove(event);
+      break;
+    case TouchEvent::Up:
+      return handleTouchUp(event);
+  }
+
+  return std::nullopt;
 }
 
 std::pair<std::vector<Gesture>, std::vector<Event>>
@@ -153,24 +311,17 @@ GestureController::handleEvents(const std::vector<Event>& events) {
       unhandled.emplace_back(event);
       continue;
     }
-    const auto& touchEv = std::get<TouchEvent>(event);
-    switch (touchEv.type) {
-      case TouchEvent::Down:
-        handleTouchDown(touchEv);
-        break;
-      case TouchEvent::Move:
-        handleTouchMove(touchEv);
-        break;
-      case TouchEvent::Up: {
-        auto gesture = handleTouchUp(touchEv);
-        if (gesture.has_value()) {
-          result.emplace_back(*gesture);
-        }
-        break;
-      }
+    auto gesture = handleEvent(std::get<TouchEvent>(event));
+    if (gesture.has_value()) {
+      result.emplace_back(*gesture);
     }
   }
 
+  // The events are complete reports, so no need to wait for the next one.
+  if (dirty) {
+    updateProgress();
+  }
+
   return { result, unhandled };
 }
 
@@ -186,6 +337,7 @@ GestureController::sync(InputDeviceBase& device) {
       std::cerr << "Desync for slot " << i << std::endl;
       if (!active) {
         slots[i].active = false;
+        dirty = true;
         if (getCurrentFingers() == 0) {
           reset();
         }
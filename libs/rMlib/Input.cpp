@@ -8,18 +8,28 @@
 #include <linux/input.h>
 
 #include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <unistd.h>
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <cstdio>
 #include <cstring>
+#include <ctime>
+#include <fstream>
 #include <iostream>
 #include <memory>
-
-#ifdef EMULATE
-#include <atomic>
+#include <mutex>
+#include <sstream>
 #include <thread>
 
+#include <sys/stat.h>
+
+#ifdef EMULATE
 #include <SDL2/SDL.h>
 #include <libevdev/libevdev-uinput.h>
 #endif
@@ -57,44 +67,154 @@ getTouchFlood() {
   return floodBuffer;
 }
 
+/// The devices use CLOCK_MONOTONIC, which is what steady_clock uses as well.
+std::chrono::steady_clock::time_point
+toTimePoint(const timeval& time) {
+  return std::chrono::steady_clock::time_point(
+    std::chrono::seconds(time.tv_sec) + std::chrono::microseconds(time.tv_usec));
+}
+
+/// Lock free queue with a single producer and a single consumer thread.
+template<typename T, std::size_t Size>
+class SPSCQueue {
+public:
+  /// \returns false if the queue is full.
+  bool push(const T& value) {
+    const auto tail = tailIdx.load(std::memory_order_relaxed);
+    const auto next = (tail + 1) % Size;
+    if (next == headIdx.load(std::memory_order_acquire)) {
+      return false;
+    }
+
+    items[tail] = value;
+    tailIdx.store(next, std::memory_order_release);
+    return true;
+  }
+
+  /// Only reliable on the producer thread.
+  bool full() const {
+    const auto next = (tailIdx.load(std::memory_order_relaxed) + 1) % Size;
+    return next == headIdx.load(std::memory_order_acquire);
+  }
+
+  template<typename Func>
+  void popAll(Func&& f) {
+    auto head = headIdx.load(std::memory_order_relaxed);
+    const auto tail = tailIdx.load(std::memory_order_acquire);
+    for (; head != tail; head = (head + 1) % Size) {
+      f(items[head]);
+    }
+    headIdx.store(head, std::memory_order_release);
+  }
+
+private:
+  std::array<T, Size> items;
+  std::atomic<std::size_t> headIdx = 0;
+  std::atomic<std::size_t> tailIdx = 0;
+};
+
 template<typename Device>
 struct InputDevice : public InputDeviceBase {
   using InputDeviceBase::InputDeviceBase;
 
   virtual OptError<> readEvents(std::vector<Event>& out) final {
-    Device* devThis = static_cast<Device*>(this);
+    // Read as many events as possible per syscall, libevdev is only used to
+    // resync after the kernel dropped events.
+    constexpr auto batch_size = 64;
+    std::array<input_event, batch_size> buffer;
+
+    while (true) {
+      const auto size = ::read(fd, buffer.data(), sizeof(buffer));
+      if (size < 0) {
+        // ENODEV means the device was unplugged, udev will remove it.
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENODEV) {
+          return NoError{};
+        }
+        if (errno == EINTR) {
+          continue;
+        }
+        return Error::errn();
+      }
 
-    int rc = 0;
-    do {
+      const auto count = std::size_t(size) / sizeof(input_event);
+      if (rawEventHook) {
+        rawEventHook(*this, buffer.data(), count);
+      }
 
-      auto event = input_event{};
-      rc = libevdev_next_event(evdev, LIBEVDEV_READ_FLAG_NORMAL, &event);
+      if (!decodeBatch(buffer.data(), count, out)) {
+        resync(out);
+        continue;
+      }
 
-      if (rc == LIBEVDEV_READ_STATUS_SUCCESS) {
-        auto evs = TRY(devThis->handleEvent(event));
-        out.insert(out.end(), evs.begin(), evs.end());
-      } else if (rc == LIBEVDEV_READ_STATUS_SYNC) {
+      if (count < batch_size) {
+        return NoError{};
+      }
+    }
+  }
 
-        while (rc == LIBEVDEV_READ_STATUS_SYNC) {
-          auto evs = TRY(devThis->handleEvent(event));
-          out.insert(out.end(), evs.begin(), evs.end());
+  void decodeEvents(const input_event* events,
+                    std::size_t count,
+                    std::vector<Event>& out) final {
+    Device* devThis = static_cast<Device*>(this);
+    for (std::size_t i = 0; i < count; i++) {
+      devThis->handleEvent(events[i], out);
+    }
+  }
 
-          rc = libevdev_next_event(evdev, LIBEVDEV_READ_FLAG_SYNC, &event);
-        }
+private:
+  /// Decodes a batch read from the device, keeping the libevdev state up to
+  /// date so slot queries and resyncs see the same state as we do.
+  /// \returns false if the kernel dropped events, the rest of the batch is
+  ///          skipped in that case.
+  bool decodeBatch(const input_event* events,
+                   std::size_t count,
+                   std::vector<Event>& out) {
+    Device* devThis = static_cast<Device*>(this);
+    for (std::size_t i = 0; i < count; i++) {
+      const auto& event = events[i];
+      if (event.type == EV_SYN && event.code == SYN_DROPPED) {
+        return false;
       }
-    } while (rc == LIBEVDEV_READ_STATUS_SYNC ||
-             rc == LIBEVDEV_READ_STATUS_SUCCESS);
 
-    return NoError{};
+      // Virtual devices have no libevdev state to keep up to date.
+      if (evdev != nullptr && (event.type == EV_ABS || event.type == EV_KEY)) {
+        libevdev_set_event_value(evdev, event.type, event.code, event.value);
+      }
+      devThis->handleEvent(event, out);
+    }
+    return true;
+  }
+
+  /// Lets libevdev query the current state from the kernel and replays the
+  /// difference. Events still queued in the kernel are discarded by libevdev.
+  void resync(std::vector<Event>& out) {
+    Device* devThis = static_cast<Device*>(this);
+    if (evdev == nullptr) {
+      return;
+    }
+
+    auto event = input_event{};
+    auto rc =
+      libevdev_next_event(evdev, LIBEVDEV_READ_FLAG_FORCE_SYNC, &event);
+    while (rc == LIBEVDEV_READ_STATUS_SYNC) {
+      if (rawEventHook) {
+        rawEventHook(*this, &event, 1);
+      }
+      devThis->handleEvent(event, out);
+      rc = libevdev_next_event(evdev, LIBEVDEV_READ_FLAG_SYNC, &event);
+    }
   }
 };
 
 struct TouchDevice : public InputDevice<TouchDevice> {
   TouchDevice(int fd, libevdev* evdev, std::string path, Transform transform)
     : InputDevice(fd, evdev, std::move(path)), transform(transform) {}
-  ErrorOr<std::vector<TouchEvent>> handleEvent(input_event);
+  void handleEvent(const input_event& event, std::vector<Event>& out);
   TouchEvent& getSlot() { return slots.at(slot); }
 
+  InputType getType() const final { return InputType::Touch; }
+  Transform getTransform() const final { return transform; }
+
   void flood() final {
     auto* buf = getTouchFlood();
     write(fd, buf, touch_flood_size * sizeof(input_event));
@@ -103,13 +223,19 @@ struct TouchDevice : public InputDevice<TouchDevice> {
   Transform transform;
   int slot = 0;
   std::array<TouchEvent, max_num_slots> slots;
-  std::unordered_set<int> changedSlots;
+
+  /// Bit i is set if slot i changed since the last report.
+  uint32_t changedSlots = 0;
+  static_assert(max_num_slots <= 32, "Changed slots must fit in the mask");
 };
 
 struct PenDevice : public InputDevice<PenDevice> {
   PenDevice(int fd, libevdev* evdev, std::string path, Transform transform)
     : InputDevice(fd, evdev, std::move(path)), transform(transform) {}
-  ErrorOr<std::vector<PenEvent>> handleEvent(input_event);
+  void handleEvent(const input_event& event, std::vector<Event>& out);
+
+  InputType getType() const final { return InputType::Pen; }
+  Transform getTransform() const final { return transform; }
 
   void flood() final {
     auto* buf = getTouchFlood();
@@ -123,7 +249,9 @@ struct PenDevice : public InputDevice<PenDevice> {
 struct KeyDevice : public InputDevice<KeyDevice> {
   KeyDevice(int fd, libevdev* evdev, std::string path)
     : InputDevice(fd, evdev, std::move(path)) {}
-  ErrorOr<std::vector<KeyEvent>> handleEvent(input_event);
+  void handleEvent(const input_event& event, std::vector<Event>& out);
+
+  InputType getType() const final { return InputType::Key; }
 
   void flood() final {
     // TODO: this probably doesn't work
@@ -131,18 +259,20 @@ struct KeyDevice : public InputDevice<KeyDevice> {
     write(fd, buf, touch_flood_size * sizeof(input_event));
   }
 
+  // Cleared after every report, so it keeps its capacity.
   std::vector<KeyEvent> keyEvents;
 };
 
-ErrorOr<std::vector<PenEvent>>
-PenDevice::handleEvent(input_event event) {
+void
+PenDevice::handleEvent(const input_event& event, std::vector<Event>& out) {
   if (event.type == EV_SYN && event.code == SYN_REPORT) {
     auto ev = penEvent;
     ev.location = transform * penEvent.location;
-    std::vector<PenEvent> events{ ev };
+    ev.time = toTimePoint(event.time);
+    out.emplace_back(ev);
 
     penEvent.type = PenEvent::Move;
-    return events;
+    return;
   }
 
   if (event.type == EV_ABS) {
@@ -170,30 +300,31 @@ PenDevice::handleEvent(input_event event) {
       }
     }
   }
-
-  return std::vector<PenEvent>{};
 }
 
-ErrorOr<std::vector<TouchEvent>>
-TouchDevice::handleEvent(input_event event) {
+void
+TouchDevice::handleEvent(const input_event& event, std::vector<Event>& out) {
   if (event.type == EV_SYN && event.code == SYN_REPORT) {
-    std::vector<TouchEvent> events;
-    for (auto slotIdx : changedSlots) {
-      auto slot = slots.at(slotIdx);
+    for (auto mask = changedSlots; mask != 0; mask &= mask - 1) {
+      const auto slotIdx = __builtin_ctz(mask);
+      auto slot = slots[slotIdx];
       slot.location = transform * slot.location;
-      events.push_back(slot);
+      slot.time = toTimePoint(event.time);
+      out.emplace_back(slot);
 
-      slots.at(slotIdx).type = TouchEvent::Move;
+      slots[slotIdx].type = TouchEvent::Move;
     }
-    changedSlots.clear();
-    return events;
+    changedSlots = 0;
+    return;
   }
 
   if (event.type == EV_ABS && event.code == ABS_MT_SLOT) {
     slot = event.value;
     getSlot().slot = event.value;
   }
-  changedSlots.insert(slot);
+  if (slot >= 0 && slot < max_num_slots) {
+    changedSlots |= 1U << slot;
+  }
 
   if (event.type == EV_ABS) {
     if (event.code == ABS_MT_TRACKING_ID) {
@@ -215,36 +346,203 @@ TouchDevice::handleEvent(input_event event) {
     } else if (event.code == ABS_MT_PRESSURE) {
       auto& slot = getSlot();
       slot.pressure = event.value;
+    } else if (event.code == ABS_MT_TOUCH_MAJOR) {
+      auto& slot = getSlot();
+      slot.size = event.value;
     }
   }
-
-  return std::vector<TouchEvent>{};
 }
 
-ErrorOr<std::vector<KeyEvent>>
-KeyDevice::handleEvent(input_event event) {
+void
+KeyDevice::handleEvent(const input_event& event, std::vector<Event>& out) {
   if (event.type == EV_KEY) {
 
     KeyEvent keyEvent;
     keyEvent.type = static_cast<decltype(keyEvent.type)>(event.value);
     keyEvent.keyCode = event.code;
+    keyEvent.time = toTimePoint(event.time);
     keyEvents.push_back(keyEvent);
 
   } else if (event.type == EV_SYN && event.code == SYN_REPORT) {
 
-    auto ret = keyEvents;
+    out.insert(out.end(), keyEvents.begin(), keyEvents.end());
     keyEvents.clear();
-    return ret;
   }
+}
 
-  return std::vector<KeyEvent>{};
+/// Identifies the device behind a device node, using the attributes in sysfs.
+/// Reading these is much cheaper than opening the device.
+std::string
+getDeviceIdentity(std::string_view devnode) {
+  const auto name = devnode.substr(devnode.rfind('/') + 1);
+  const auto base = "/sys/class/input/" + std::string(name) + "/device/";
+
+  std::string result;
+  for (const auto* attr :
+       { "name", "id/bustype", "id/vendor", "id/product", "id/version" }) {
+    std::ifstream ifs(base + attr);
+    std::string line;
+    std::getline(ifs, line);
+    result += line;
+    result += ';';
+  }
+  return result;
+}
+
+/// Remembers the kind of device behind every device node, keyed by its sysfs
+/// identity. Lets the background scan skip nodes that can't be used and
+/// avoids probing the capabilities of known devices.
+class DeviceCache {
+public:
+  /// Unusable marks nodes that aren't evdev devices, like /dev/input/mice.
+  enum Kind { Touch, Pen, Key, Unusable };
+
+  static DeviceCache& get() {
+    static DeviceCache cache;
+    return cache;
+  }
+
+  std::optional<Kind> lookup(const std::string& devnode,
+                             const std::string& identity) {
+    std::lock_guard lock(mutex);
+    auto it = entries.find(devnode);
+    if (it == entries.end() || it->second.identity != identity) {
+      return std::nullopt;
+    }
+    return it->second.kind;
+  }
+
+  void store(const std::string& devnode,
+             const std::string& identity,
+             Kind kind) {
+    std::lock_guard lock(mutex);
+    if (set(devnode, identity, kind)) {
+      write();
+    }
+  }
+
+  /// Like `store`, but doesn't write the cache file. Call `save` once after a
+  /// batch of updates.
+  void update(const std::string& devnode,
+              const std::string& identity,
+              Kind kind) {
+    std::lock_guard lock(mutex);
+    dirty |= set(devnode, identity, kind);
+  }
+
+  /// Writes the cache file if `update` changed it.
+  void save() {
+    std::lock_guard lock(mutex);
+    if (dirty) {
+      write();
+    }
+  }
+
+private:
+  constexpr static auto cache_dir_suffix = "/.cache/rmlib";
+
+  struct Entry {
+    std::string identity;
+    Kind kind = Unusable;
+  };
+
+  DeviceCache() {
+    if (const auto* home = getenv("HOME"); home != nullptr) {
+      dir = std::string(home) + cache_dir_suffix;
+      load();
+    }
+  }
+
+  std::string getPath() const { return dir + "/input-devices"; }
+
+  /// One device per line: node, identity and kind, separated by tabs.
+  void load() {
+    std::ifstream ifs(getPath());
+    std::string line;
+    while (std::getline(ifs, line)) {
+      std::stringstream ss(line);
+      std::string devnode;
+      std::string identity;
+      int kind = 0;
+      if (std::getline(ss, devnode, '\t') && std::getline(ss, identity, '\t') &&
+          ss >> kind && kind >= Touch && kind <= Unusable) {
+        entries[devnode] = Entry{ identity, Kind(kind) };
+      }
+    }
+  }
+
+  /// \returns Whether the entry changed.
+  bool set(const std::string& devnode, const std::string& identity, Kind kind) {
+    auto& entry = entries[devnode];
+    if (entry.identity == identity && entry.kind == kind) {
+      return false;
+    }
+    entry = Entry{ identity, kind };
+    return true;
+  }
+
+  void write() {
+    dirty = false;
+    if (dir.empty()) {
+      return;
+    }
+    mkdir(dir.substr(0, dir.rfind('/')).c_str(), 0755);
+    mkdir(dir.c_str(), 0755);
+
+    // Write to a temporary file first, so readers never see a partial file.
+    const auto path = getPath();
+    const auto tmpPath = path + ".tmp";
+    {
+      std::ofstream ofs(tmpPath);
+      for (const auto& [devnode, entry] : entries) {
+        ofs << devnode << '\t' << entry.identity << '\t' << int(entry.kind)
+            << '\n';
+      }
+      if (!ofs) {
+        return;
+      }
+    }
+    std::rename(tmpPath.c_str(), path.c_str());
+  }
+
+  std::mutex mutex;
+  std::string dir;
+  std::unordered_map<std::string, Entry> entries;
+  bool dirty = false;
+};
+
+DeviceCache::Kind
+toCacheKind(InputType type) {
+  switch (type) {
+    case InputType::Touch:
+      return DeviceCache::Touch;
+    case InputType::Pen:
+      return DeviceCache::Pen;
+    case InputType::Key:
+    default:
+      return DeviceCache::Key;
+  }
 }
 
 std::unique_ptr<InputDeviceBase>
 makeDevice(int fd,
            libevdev* evdev,
            std::string path,
-           Transform transform = {}) {
+           Transform transform,
+           std::optional<DeviceCache::Kind> kind) {
+  // Known from the cache, no need to probe.
+  switch (kind.value_or(DeviceCache::Unusable)) {
+    case DeviceCache::Touch:
+      return std::make_unique<TouchDevice>(
+        fd, evdev, std::move(path), transform);
+    case DeviceCache::Pen:
+      return std::make_unique<PenDevice>(fd, evdev, std::move(path), transform);
+    case DeviceCache::Key:
+      return std::make_unique<KeyDevice>(fd, evdev, std::move(path));
+    case DeviceCache::Unusable:
+      break;
+  }
+
   if (libevdev_has_event_type(evdev, EV_ABS)) {
     // multi-touch screen -> ev_abs & abs_mt_slot
     if (libevdev_has_event_code(evdev, EV_ABS, ABS_MT_SLOT)) {
@@ -266,6 +564,66 @@ makeDevice(int fd,
   return std::make_unique<KeyDevice>(fd, evdev, std::move(path));
 }
 
+/// Opens the device node and finds out what kind of device it is. Doesn't
+/// touch the input manager, so the scan thread can use it.
+/// \param explicitOpen The node was opened on request instead of by the scan.
+///                     Writes the device cache right away if the entry changed,
+///                     otherwise `DeviceCache::save` must be called later. Also
+///                     probes nodes the cache marks as unusable again.
+ErrorOr<std::unique_ptr<InputDeviceBase>>
+probeDevice(const std::string& path, Transform transform, bool explicitOpen) {
+  auto& cache = DeviceCache::get();
+  const auto identity = getDeviceIdentity(path);
+  auto kind = cache.lookup(path, identity);
+  if (kind == DeviceCache::Unusable) {
+    if (!explicitOpen) {
+      return Error{ "'" + path + "' is not an input device" };
+    }
+    kind = std::nullopt;
+  }
+
+  const auto store = [&](DeviceCache::Kind newKind) {
+    if (explicitOpen) {
+      cache.store(path, identity, newKind);
+    } else {
+      cache.update(path, identity, newKind);
+    }
+  };
+
+  int fd = ::open(path.c_str(), O_RDWR | O_NONBLOCK);
+  if (fd < 0) {
+    return Error{ "Couldn't open '" + path + "'" };
+  }
+
+  libevdev* dev = nullptr;
+  if (const auto err = libevdev_new_from_fd(fd, &dev); err < 0) {
+    ::close(fd);
+
+    // Only the evdev ioctls not being supported means the node will never be
+    // usable, other errors can be temporary.
+    if (err == -ENOTTY) {
+      store(DeviceCache::Unusable);
+    }
+    return Error{ "Error initializing evdev for '" + path +
+                  "': " + strerror(-err) };
+  }
+
+  // Timestamps from the same clock as std::chrono::steady_clock.
+  libevdev_set_clock_id(dev, CLOCK_MONOTONIC);
+
+  auto device = makeDevice(fd, dev, path, transform, kind);
+  if (!kind.has_value()) {
+    store(toCacheKind(device->getType()));
+  }
+  return device;
+}
+
+Transform
+getTransform(std::string_view path) {
+  const auto optTransform = device::getInputTransform(path);
+  return optTransform.has_value() ? *optTransform : Transform{};
+}
+
 void
 handeDevice(InputManager& mgr, udev_device& dev) {
   auto* devnode = udev_device_get_devnode(&dev);
@@ -279,7 +637,7 @@ handeDevice(InputManager& mgr, udev_device& dev) {
     return;
   }
   std::cout << "action: " << action << "\n";
-  mgr.devices.erase(devnode);
+  mgr.close(devnode);
 }
 
 #ifdef EMULATE
@@ -399,7 +757,295 @@ InputDeviceBase::~InputDeviceBase() {
   }
 }
 
+/// Reads the devices on its own thread, see `InputManager::startInputThread`.
+struct InputReader {
+  // Enough for several seconds of pen input.
+  constexpr static auto queue_size = 4096;
+
+  ~InputReader() { stop(); }
+
+  OptError<> start() {
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    wakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    stopFd = eventfd(0, EFD_CLOEXEC);
+    spaceFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (epollFd < 0 || wakeFd < 0 || stopFd < 0 || spaceFd < 0) {
+      return Error::errn();
+    }
+
+    auto ev = epoll_event{};
+    ev.events = EPOLLIN;
+    ev.data.fd = stopFd;
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, stopFd, &ev) < 0) {
+      return Error::errn();
+    }
+
+    thread = std::thread([this] { run(); });
+
+    // Real time priority, so input is read as soon as it arrives, even when
+    // the UI thread is busy drawing.
+    auto param = sched_param{};
+    param.sched_priority = sched_get_priority_min(SCHED_FIFO);
+    if (auto err =
+          pthread_setschedparam(thread.native_handle(), SCHED_FIFO, &param);
+        err != 0) {
+      std::cerr << "Couldn't raise input thread priority: " << strerror(err)
+                << "\n";
+    }
+
+    return NoError{};
+  }
+
+  void stop() {
+    if (thread.joinable()) {
+      const uint64_t one = 1;
+      write(stopFd, &one, sizeof(one));
+      thread.join();
+    }
+
+    for (auto* fd : { &epollFd, &wakeFd, &stopFd, &spaceFd }) {
+      if (*fd >= 0) {
+        ::close(*fd);
+        *fd = -1;
+      }
+    }
+  }
+
+  OptError<> add(int fd, InputDeviceBase* device) {
+    std::lock_guard lock(mutex);
+
+    // The devices are read until EAGAIN, so edge triggered is enough.
+    auto ev = epoll_event{};
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.fd = fd;
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+      return Error::errn();
+    }
+
+    devices.emplace(fd, device);
+    return NoError{};
+  }
+
+  /// After this returns the device is no longer used by the thread.
+  void remove(int fd) {
+    std::lock_guard lock(mutex);
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+    devices.erase(fd);
+  }
+
+  /// Called on the UI thread when `wakeFd` is readable.
+  void drain(std::vector<Event>& out) {
+    uint64_t count = 0;
+    read(wakeFd, &count, sizeof(count));
+
+    queue.popAll([&out](const Event& ev) { out.push_back(ev); });
+
+    // Pairs with the fence in `waitForSpace`, so either the reader sees the
+    // space or we see that it's waiting.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (waiting.exchange(false)) {
+      const uint64_t one = 1;
+      write(spaceFd, &one, sizeof(one));
+    }
+  }
+
+  void wake() {
+    const uint64_t one = 1;
+    write(wakeFd, &one, sizeof(one));
+  }
+
+  /// Blocks the reader until `drain` made room in the queue.
+  /// \returns false if the thread should stop.
+  bool waitForSpace() {
+    waiting.store(true);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!queue.full()) {
+      waiting.store(false);
+      return true;
+    }
+
+    std::array<pollfd, 2> fds = { { { spaceFd, POLLIN, 0 },
+                                     { stopFd, POLLIN, 0 } } };
+    while (poll(fds.data(), fds.size(), -1) < 0) {
+      if (errno != EINTR) {
+        perror("Waiting for input queue failed");
+        return false;
+      }
+    }
+    if ((fds[1].revents & POLLIN) != 0) {
+      return false;
+    }
+
+    uint64_t count = 0;
+    read(spaceFd, &count, sizeof(count));
+    return true;
+  }
+
+  void run() {
+    constexpr auto max_events = 16;
+    std::array<epoll_event, max_events> ready;
+
+    // Reused, so reading doesn't allocate.
+    std::vector<Event> events;
+
+    while (true) {
+      const auto ret = epoll_wait(epollFd, ready.data(), max_events, -1);
+      if (ret < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        perror("Waiting on input failed");
+        return;
+      }
+
+      events.clear();
+      for (int i = 0; i < ret; i++) {
+        const auto fd = ready[i].data.fd;
+        if (fd == stopFd) {
+          return;
+        }
+
+        std::lock_guard lock(mutex);
+        if (auto it = devices.find(fd); it != devices.end()) {
+          if (auto err = it->second->readEvents(events); err.isError()) {
+            std::cerr << "Reading input failed: " << err.getError().msg
+                      << "\n";
+          }
+        }
+      }
+
+      if (events.empty()) {
+        continue;
+      }
+
+      // Never drop events when the queue is full, as losing an up or leave
+      // event breaks the state of the app. Stop reading until the UI thread
+      // catches up instead, the kernel buffers the input meanwhile. If that
+      // overflows as well, the resync restores the device state.
+      for (std::size_t i = 0; i < events.size();) {
+        if (queue.push(events[i])) {
+          i++;
+          continue;
+        }
+
+        wake();
+        if (!waitForSpace()) {
+          return;
+        }
+      }
+
+      wake();
+    }
+  }
+
+  int epollFd = -1;
+
+  /// Readable when there are events in the queue.
+  int wakeFd = -1;
+  int stopFd = -1;
+
+  /// Written by `drain` when the reader is waiting for space in the queue.
+  int spaceFd = -1;
+  std::atomic<bool> waiting = false;
+
+  /// Guards `devices`, which is changed on the UI thread on hotplug.
+  std::mutex mutex;
+  std::unordered_map<int, InputDeviceBase*> devices;
+
+  SPSCQueue<Event, queue_size> queue;
+
+  std::thread thread;
+};
+
+/// Enumerates, opens and probes the input devices on a separate thread, so
+/// startup only needs to open the base devices.
+struct DeviceScan {
+  ~DeviceScan() {
+    if (thread.joinable()) {
+      thread.join();
+    }
+    if (doneFd >= 0) {
+      ::close(doneFd);
+    }
+  }
+
+  OptError<> start() {
+    doneFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (doneFd < 0) {
+      return Error::errn();
+    }
+
+    thread = std::thread([this] { run(); });
+    return NoError{};
+  }
+
+  void run() {
+    // udev handles can't be shared between threads.
+    auto* handle = udev_new();
+    auto* enumerate = udev_enumerate_new(handle);
+    udev_enumerate_add_match_subsystem(enumerate, "input");
+    udev_enumerate_scan_devices(enumerate);
+
+    auto& cache = DeviceCache::get();
+    struct udev_list_entry* entry;
+    udev_list_entry_foreach(entry, udev_enumerate_get_list_entry(enumerate)) {
+      const char* path = udev_list_entry_get_name(entry);
+      auto* dev = udev_device_new_from_syspath(handle, path);
+      if (dev == nullptr) {
+        continue;
+      }
+
+      if (const auto* devnode = udev_device_get_devnode(dev);
+          devnode != nullptr && std::find(skip.begin(), skip.end(), devnode) ==
+                                  skip.end()) {
+        // Not all nodes are usable, like the joystick ones.
+        auto device = probeDevice(devnode, getTransform(devnode), false);
+        if (!device.isError()) {
+          devices.emplace_back(std::move(*device));
+        }
+      }
+      udev_device_unref(dev);
+    }
+
+    udev_enumerate_unref(enumerate);
+    udev_unref(handle);
+
+    // Once for all devices, instead of once per new device.
+    cache.save();
+
+    const uint64_t one = 1;
+    write(doneFd, &one, sizeof(one));
+  }
+
+  /// Device nodes that are already open, set before `start`.
+  std::vector<std::string> skip;
+
+  /// Readable once the scan is done, `devices` can be used after that.
+  int doneFd = -1;
+  std::vector<std::unique_ptr<InputDeviceBase>> devices;
+
+  std::thread thread;
+};
+
+std::unique_ptr<InputDeviceBase>
+makeVirtualDevice(InputType type, Transform transform, int fd) {
+  switch (type) {
+    case InputType::Touch:
+      return std::make_unique<TouchDevice>(fd, nullptr, "virtual", transform);
+    case InputType::Pen:
+      return std::make_unique<PenDevice>(fd, nullptr, "virtual", transform);
+    case InputType::Key:
+      return std::make_unique<KeyDevice>(fd, nullptr, "virtual");
+  }
+  return nullptr;
+}
+
 InputManager::InputManager() {
+  epollFd = epoll_create1(EPOLL_CLOEXEC);
+  if (epollFd < 0) {
+    perror("Error creating epoll fd");
+  }
+
 #ifdef EMULATE
   if (!input_ready) {
     inputThread = std::thread(uinput_thread);
@@ -410,7 +1056,52 @@ InputManager::InputManager() {
 #endif
 }
 
+InputManager::InputManager(InputManager&& other)
+  : devices(std::move(other.devices))
+  , baseDevices(std::exchange(other.baseDevices, std::nullopt))
+  , udevHandle(std::exchange(other.udevHandle, nullptr))
+  , udevMonitor(std::exchange(other.udevMonitor, nullptr))
+  , udevMonitorFd(std::exchange(other.udevMonitorFd, -1))
+  , epollFd(std::exchange(other.epollFd, -1))
+  , deviceFds(std::move(other.deviceFds))
+  , fdCallbacks(std::move(other.fdCallbacks))
+  , rawEventHook(std::move(other.rawEventHook))
+  , palmFilter(std::move(other.palmFilter))
+  , inputReader(std::move(other.inputReader))
+  , deviceScan(std::move(other.deviceScan)) {
+  other.devices.clear();
+  other.deviceFds.clear();
+  other.fdCallbacks.clear();
+}
+
+InputManager&
+InputManager::operator=(InputManager&& other) {
+  // The old state is cleaned up by the destructor of other.
+  std::swap(devices, other.devices);
+  // BaseDevices holds references, so it can't be swapped.
+  baseDevices.reset();
+  if (other.baseDevices.has_value()) {
+    baseDevices.emplace(*other.baseDevices);
+    other.baseDevices.reset();
+  }
+  std::swap(udevHandle, other.udevHandle);
+  std::swap(udevMonitor, other.udevMonitor);
+  std::swap(udevMonitorFd, other.udevMonitorFd);
+  std::swap(epollFd, other.epollFd);
+  std::swap(deviceFds, other.deviceFds);
+  std::swap(fdCallbacks, other.fdCallbacks);
+  std::swap(rawEventHook, other.rawEventHook);
+  std::swap(palmFilter, other.palmFilter);
+  std::swap(inputReader, other.inputReader);
+  std::swap(deviceScan, other.deviceScan);
+  return *this;
+}
+
 InputManager::~InputManager() {
+  // Stop reading before the devices are closed.
+  inputReader.reset();
+  deviceScan.reset();
+
   if (udevHandle != nullptr) {
     udev_unref(udevHandle);
   }
@@ -418,6 +1109,12 @@ InputManager::~InputManager() {
     udev_monitor_unref(udevMonitor);
   }
 
+  // Close the devices before the epoll fd they're registered with.
+  devices.clear();
+  if (epollFd >= 0) {
+    ::close(epollFd);
+  }
+
 #ifdef EMULATE
   stop_input = true;
   if (inputThread.joinable()) {
@@ -432,134 +1129,278 @@ InputManager::open(std::string_view input, Transform inputTransform) {
     return &*it->second;
   }
 
-  int fd = ::open(input.data(), O_RDWR | O_NONBLOCK);
-  if (fd < 0) {
-    return Error{ "Couldn't open '" + std::string(input) + "'" };
-  }
+  auto device = TRY(probeDevice(std::string(input), inputTransform, true));
+  return add(std::move(device));
+}
 
-  libevdev* dev = nullptr;
-  if (libevdev_new_from_fd(fd, &dev) < 0) {
-    close(fd);
-    return Error{ "Error initializing evdev for '" + std::string(input) + "'" };
+ErrorOr<InputDeviceBase*>
+InputManager::add(std::unique_ptr<InputDeviceBase> device) {
+  device->rawEventHook = rawEventHook;
+  auto* devicePtr = device.get();
+  const auto fd = device->fd;
+
+  if (inputReader != nullptr) {
+    if (auto err = inputReader->add(fd, devicePtr); err.isError()) {
+      return err.getError();
+    }
+  } else {
+    // The devices are read until EAGAIN, so edge triggered is enough.
+    if (auto err = watch(fd, /* edgeTriggered */ true); err.isError()) {
+      return err.getError();
+    }
+    deviceFds.emplace(fd, devicePtr);
   }
 
-  auto device = makeDevice(fd, dev, std::string(input), inputTransform);
-  auto* devicePtr = device.get();
   devices.emplace(devicePtr->path, std::move(device));
   return devicePtr;
 }
 
+void
+InputManager::close(std::string_view input) {
+  auto it = devices.find(input);
+  if (it == devices.end()) {
+    return;
+  }
+
+  if (inputReader != nullptr) {
+    inputReader->remove(it->second->fd);
+  } else {
+    unwatch(it->second->fd);
+    deviceFds.erase(it->second->fd);
+  }
+  devices.erase(it);
+}
+
 ErrorOr<InputDeviceBase*>
 InputManager::open(std::string_view input) {
-  const auto optTransform = device::getInputTransform(input);
-  return open(input, optTransform.has_value() ? *optTransform : Transform{});
+  return open(input, getTransform(input));
 }
 
 ErrorOr<BaseDevices>
 InputManager::openAll(bool monitor) {
-  udev* udevHandle =
-    this->udevHandle == nullptr ? udev_new() : this->udevHandle;
-
-  udev_enumerate* enumerate = udev_enumerate_new(udevHandle);
-  udev_enumerate_add_match_subsystem(enumerate, "input");
-  udev_enumerate_scan_devices(enumerate);
-
-  struct udev_list_entry* devList = udev_enumerate_get_list_entry(enumerate);
-  struct udev_list_entry* entry;
-
-  udev_list_entry_foreach(entry, devList) {
-    const char* path = udev_list_entry_get_name(entry);
-    struct udev_device* dev = udev_device_new_from_syspath(udevHandle, path);
-    if (dev != nullptr) {
-      handeDevice(*this, *dev);
-      udev_device_unref(dev);
-    }
-  }
+  const auto type = TRY(device::getDeviceType());
+  const auto& paths = device::getInputPaths(type);
 
-  udev_enumerate_unref(enumerate);
+  // Open the devices we know about directly, enumerating all devices is slow.
+  auto* touch = TRY(open(paths.touchPath, paths.touchTransform));
+  auto* pen = TRY(open(paths.penPath, paths.penTransform));
+  auto* key = TRY(open(paths.buttonPath, Transform{}));
 
   if (monitor) {
-    this->udevHandle = udevHandle;
+    if (udevHandle == nullptr) {
+      udevHandle = udev_new();
+    }
 
     udevMonitor = udev_monitor_new_from_netlink(udevHandle, "udev");
     udev_monitor_filter_add_match_subsystem_devtype(udevMonitor, "input", NULL);
     udev_monitor_enable_receiving(udevMonitor);
     udevMonitorFd = udev_monitor_get_fd(udevMonitor);
-
-  } else {
-    udev_unref(udevHandle);
-    this->udevHandle = nullptr;
-    this->udevMonitorFd = -1;
+    if (auto err = watch(udevMonitorFd, /* edgeTriggered */ false);
+        err.isError()) {
+      return err.getError();
+    }
   }
 
-  auto type = TRY(device::getDeviceType());
-  auto paths = device::getInputPaths(type);
-
-  auto* touch = devices.at(paths.touchPath).get();
-  auto* pen = devices.at(paths.penPath).get();
-  auto* key = devices.at(paths.buttonPath).get();
+  // Other devices, like USB keyboards, are opened once the scan is done.
+  if (deviceScan == nullptr) {
+    auto scan = std::make_unique<DeviceScan>();
+    for (const auto& [path, _] : devices) {
+      scan->skip.emplace_back(path);
+    }
+    if (auto err = scan->start(); err.isError()) {
+      std::cerr << "Scanning input devices failed: " << err.getError().msg
+                << "\n";
+    } else if (auto err = watch(scan->doneFd, /* edgeTriggered */ false);
+               err.isError()) {
+      std::cerr << err.getError().msg << "\n";
+    } else {
+      deviceScan = std::move(scan);
+    }
+  }
 
   baseDevices.emplace(BaseDevices{ *pen, *touch, *key });
   return *baseDevices;
 }
 
-ErrorOr<std::vector<Event>>
-InputManager::waitForInput(fd_set& fdSet,
-                           int maxFd,
-                           std::optional<std::chrono::microseconds> timeout) {
+void
+InputManager::finishScan() {
+  unwatch(deviceScan->doneFd);
+
+  // The thread is done at this point, so this doesn't block.
+  deviceScan->thread.join();
+  auto scanned = std::move(deviceScan->devices);
+  deviceScan.reset();
+
+  // Already probed, so this only registers them.
+  for (auto& device : scanned) {
+    // Might have been opened by a udev event in the meantime.
+    if (devices.count(device->path) != 0) {
+      continue;
+    }
+    if (auto err = add(std::move(device)); err.isError()) {
+      std::cerr << err.getError().msg << "\n";
+    }
+  }
+}
+
+OptError<>
+InputManager::watch(int fd, bool edgeTriggered) {
+  auto ev = epoll_event{};
+  ev.events = EPOLLIN | (edgeTriggered ? uint32_t(EPOLLET) : 0);
+  ev.data.fd = fd;
+  if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+    return Error{ "Error watching fd " + std::to_string(fd) + ": " +
+                  strerror(errno) };
+  }
+  return NoError{};
+}
+
+void
+InputManager::unwatch(int fd) {
+  epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+}
+
+OptError<>
+InputManager::addEventSource(int fd,
+                             EventSource source,
+                             bool edgeTriggered) {
+  if (fdCallbacks.count(fd) != 0) {
+    return Error{ "Fd " + std::to_string(fd) + " is already watched" };
+  }
+
+  if (auto err = watch(fd, edgeTriggered); err.isError()) {
+    return err.getError();
+  }
+  fdCallbacks.emplace(fd, std::make_unique<EventSource>(std::move(source)));
+  return NoError{};
+}
+
+void
+InputManager::removeFd(int fd) {
+  auto it = fdCallbacks.find(fd);
+  if (it == fdCallbacks.end()) {
+    return;
+  }
+
+  unwatch(fd);
+  // The callback might be the one removing itself, so keep it alive until it
+  // returns.
+  if (inFdCallback) {
+    removedCallbacks.emplace_back(std::move(it->second));
+  }
+  fdCallbacks.erase(it);
+}
+
+void
+InputManager::setRawEventHook(RawEventHook hook) {
+  rawEventHook = std::move(hook);
   for (auto& [_, device] : devices) {
-    (void)_;
-    FD_SET(device->fd, &fdSet); // NOLINT
-    maxFd = std::max(device->fd, maxFd);
+    device->rawEventHook = rawEventHook;
   }
+}
 
-  if (udevMonitorFd >= 0) {
-    FD_SET(udevMonitorFd, &fdSet);
-    maxFd = std::max(maxFd, udevMonitorFd);
+OptError<>
+InputManager::startInputThread() {
+  if (inputReader != nullptr) {
+    return NoError{};
   }
 
-  auto tv = timeval{ 0, 0 };
-  if (timeout.has_value()) {
-    constexpr auto second_in_usec =
-      std::chrono::microseconds(std::chrono::seconds(1)).count();
-    tv.tv_sec =
-      std::chrono::duration_cast<std::chrono::seconds>(*timeout).count();
-    tv.tv_usec = timeout->count() - (tv.tv_sec * second_in_usec);
+  auto reader = std::make_unique<InputReader>();
+  if (auto err = reader->start(); err.isError()) {
+    return err.getError();
   }
 
-  auto ret = select(
-    maxFd + 1, &fdSet, nullptr, nullptr, !timeout.has_value() ? nullptr : &tv);
-  if (ret < 0) {
-    perror("Select on input failed");
-    return Error{ "Select failed" };
+  if (auto err = watch(reader->wakeFd, /* edgeTriggered */ false);
+      err.isError()) {
+    return err.getError();
   }
 
-  if (ret == 0) {
-    // timeout
-    return std::vector<Event>{};
+  // Move the already open devices to the reader thread. They are only
+  // unwatched once all are added, so they're still read here on failure.
+  for (const auto& [fd, device] : deviceFds) {
+    if (auto err = reader->add(fd, device); err.isError()) {
+      unwatch(reader->wakeFd);
+      return err.getError();
+    }
+  }
+  for (const auto& [fd, _] : deviceFds) {
+    unwatch(fd);
   }
+  deviceFds.clear();
 
-  if (udevMonitorFd >= 0 && FD_ISSET(udevMonitorFd, &fdSet)) {
-    udev_device* dev = udev_monitor_receive_device(udevMonitor);
-    if (dev) {
-      handeDevice(*this, *dev);
-      udev_device_unref(dev);
+  inputReader = std::move(reader);
+  return NoError{};
+}
+
+OptError<>
+InputManager::waitForInput(std::vector<Event>& out,
+                           std::optional<std::chrono::microseconds> timeout) {
+  constexpr auto max_events = 16;
+
+  if (epollFd < 0) {
+    return Error{ "No epoll fd" };
+  }
+
+  // Round up, so we don't wake up just before the timeout.
+  const int timeoutMs =
+    timeout.has_value()
+      ? int(std::chrono::ceil<std::chrono::milliseconds>(*timeout).count())
+      : -1;
+
+  const auto firstEvent = out.size();
+
+  std::array<epoll_event, max_events> events;
+  auto ret = epoll_wait(epollFd, events.data(), max_events, timeoutMs);
+  if (ret < 0) {
+    if (errno == EINTR) {
+      return NoError{};
     }
+    perror("Waiting on input failed");
+    return Error{ "epoll_wait failed" };
   }
 
-  // Return the first device we see.
-  std::vector<Event> result;
-  for (auto& [_, device] : devices) {
-    (void)_;
-    if (!FD_ISSET(device->fd, &fdSet)) { // NOLINT
+  for (int i = 0; i < ret; i++) {
+    const auto fd = events[i].data.fd;
+
+    if (fd == udevMonitorFd) {
+      udev_device* dev = udev_monitor_receive_device(udevMonitor);
+      if (dev) {
+        handeDevice(*this, *dev);
+        udev_device_unref(dev);
+      }
       continue;
     }
 
-    if (auto err = device->readEvents(result); err.isError()) {
-      return err.getError();
+    if (deviceScan != nullptr && fd == deviceScan->doneFd) {
+      finishScan();
+      continue;
+    }
+
+    if (inputReader != nullptr && fd == inputReader->wakeFd) {
+      inputReader->drain(out);
+      continue;
+    }
+
+    // Look up the fd every time, earlier events might have removed it.
+    if (auto it = deviceFds.find(fd); it != deviceFds.end()) {
+      if (auto err = it->second->readEvents(out); err.isError()) {
+        return err.getError();
+      }
+      continue;
+    }
+
+    if (auto it = fdCallbacks.find(fd); it != fdCallbacks.end()) {
+      inFdCallback = true;
+      (*it->second)(out);
+      inFdCallback = false;
+      removedCallbacks.clear();
     }
   }
 
-  return result;
+  if (palmFilter.has_value()) {
+    palmFilter->filter(out, firstEvent);
+  }
+
+  return NoError{};
 }
 } // namespace rmlib::input
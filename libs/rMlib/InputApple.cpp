@@ -4,11 +4,16 @@
 #include <thread>
 
 #include <sys/select.h>
+#include <unistd.h>
 
 #include <SDL.h>
 
 namespace rmlib::input {
 
+// Input is read using SDL on the UI thread, there's no reader thread.
+struct InputReader {};
+struct DeviceScan {};
+
 void
 InputDeviceBase::grab() {}
 
@@ -22,14 +27,67 @@ struct FakeInputDevice : public InputDeviceBase {
   FakeInputDevice() : InputDeviceBase(0, nullptr, "test") {}
 
   void flood() final {}
+  InputType getType() const final { return InputType::Touch; }
   OptError<> readEvents(std::vector<Event>& out) final { return NoError{}; }
+  void decodeEvents(const input_event* events,
+                    std::size_t count,
+                    std::vector<Event>& out) final {}
 };
 } // namespace
 
+std::unique_ptr<InputDeviceBase>
+makeVirtualDevice(InputType type, Transform transform, int fd) {
+  if (fd != -1) {
+    close(fd);
+  }
+  return std::make_unique<FakeInputDevice>();
+}
+
 InputManager::InputManager() {}
 
 InputManager::~InputManager() {}
 
+InputManager::InputManager(InputManager&& other)
+  : devices(std::move(other.devices))
+  , baseDevices(std::exchange(other.baseDevices, std::nullopt))
+  , udevHandle(std::exchange(other.udevHandle, nullptr))
+  , udevMonitor(std::exchange(other.udevMonitor, nullptr))
+  , udevMonitorFd(std::exchange(other.udevMonitorFd, -1))
+  , epollFd(std::exchange(other.epollFd, -1))
+  , deviceFds(std::move(other.deviceFds))
+  , fdCallbacks(std::move(other.fdCallbacks))
+  , rawEventHook(std::move(other.rawEventHook))
+  , palmFilter(std::move(other.palmFilter))
+  , inputReader(std::move(other.inputReader))
+  , deviceScan(std::move(other.deviceScan)) {
+  other.devices.clear();
+  other.deviceFds.clear();
+  other.fdCallbacks.clear();
+}
+
+InputManager&
+InputManager::operator=(InputManager&& other) {
+  // The old state is cleaned up by the destructor of other.
+  std::swap(devices, other.devices);
+  // BaseDevices holds references, so it can't be swapped.
+  baseDevices.reset();
+  if (other.baseDevices.has_value()) {
+    baseDevices.emplace(*other.baseDevices);
+    other.baseDevices.reset();
+  }
+  std::swap(udevHandle, other.udevHandle);
+  std::swap(udevMonitor, other.udevMonitor);
+  std::swap(udevMonitorFd, other.udevMonitorFd);
+  std::swap(epollFd, other.epollFd);
+  std::swap(deviceFds, other.deviceFds);
+  std::swap(fdCallbacks, other.fdCallbacks);
+  std::swap(rawEventHook, other.rawEventHook);
+  std::swap(palmFilter, other.palmFilter);
+  std::swap(inputReader, other.inputReader);
+  std::swap(deviceScan, other.deviceScan);
+  return *this;
+}
+
 ErrorOr<BaseDevices>
 InputManager::openAll(bool monitor) {
   auto fakeDev = std::make_unique<FakeInputDevice>();
@@ -39,14 +97,65 @@ InputManager::openAll(bool monitor) {
   return BaseDevices{ fakeDevRef, fakeDevRef, fakeDevRef };
 }
 
-ErrorOr<std::vector<Event>>
-InputManager::waitForInput(fd_set& fdSet,
-                           int maxFd,
+void
+InputManager::close(std::string_view input) {
+  devices.erase(input);
+}
+
+OptError<>
+InputManager::addEventSource(int fd,
+                             EventSource source,
+                             bool edgeTriggered) {
+  if (fdCallbacks.count(fd) != 0) {
+    return Error{ "Fd " + std::to_string(fd) + " is already watched" };
+  }
+  fdCallbacks.emplace(fd, std::make_unique<EventSource>(std::move(source)));
+  return NoError{};
+}
+
+void
+InputManager::removeFd(int fd) {
+  auto it = fdCallbacks.find(fd);
+  if (it == fdCallbacks.end()) {
+    return;
+  }
+
+  // The callback might be the one removing itself, so keep it alive until it
+  // returns.
+  if (inFdCallback) {
+    removedCallbacks.emplace_back(std::move(it->second));
+  }
+  fdCallbacks.erase(it);
+}
+
+void
+InputManager::setRawEventHook(RawEventHook hook) {
+  rawEventHook = std::move(hook);
+}
+
+OptError<>
+InputManager::startInputThread() {
+  return NoError{};
+}
+
+OptError<>
+InputManager::waitForInput(std::vector<Event>& out,
                            std::optional<std::chrono::microseconds> timeout) {
   static bool down = false;
 
+  // There's no epoll on macOS, select on the extra fds in a thread while
+  // waiting for SDL events.
+  fd_set fdSet;
+  FD_ZERO(&fdSet);
+  int maxFd = -1;
+  for (const auto& [fd, _] : fdCallbacks) {
+    (void)_;
+    FD_SET(fd, &fdSet);
+    maxFd = std::max(maxFd, fd);
+  }
+
   std::thread selectThread([maxFd, &fdSet, &timeout]() {
-    if (maxFd == 0 && !FD_ISSET(0, &fdSet)) {
+    if (maxFd < 0) {
       return;
     }
 
@@ -88,12 +197,27 @@ InputManager::waitForInput(fd_set& fdSet,
 
   selectThread.join();
 
+  if (maxFd >= 0) {
+    for (int fd = 0; fd <= maxFd; fd++) {
+      if (!FD_ISSET(fd, &fdSet)) {
+        continue;
+      }
+
+      if (auto it = fdCallbacks.find(fd); it != fdCallbacks.end()) {
+        inFdCallback = true;
+        (*it->second)(out);
+        inFdCallback = false;
+        removedCallbacks.clear();
+      }
+    }
+  }
+
   TouchEvent ev;
   ev.id = 1;
   ev.pressure = 1;
   ev.slot = 1;
+  ev.time = std::chrono::steady_clock::now();
 
-  std::vector<Event> result;
   switch (event.type) {
     case SDL_QUIT:
       std::exit(0);
@@ -108,7 +232,7 @@ InputManager::waitForInput(fd_set& fdSet,
         auto y = event.motion.y * EMULATE_SCALE;
         ev.type = TouchEvent::Move;
         ev.location = { x, y };
-        result.push_back(ev);
+        out.push_back(ev);
       }
       break;
     case SDL_MOUSEBUTTONDOWN:
@@ -118,7 +242,7 @@ InputManager::waitForInput(fd_set& fdSet,
         down = true;
         ev.type = TouchEvent::Down;
         ev.location = { x, y };
-        result.push_back(ev);
+        out.push_back(ev);
       }
       break;
     case SDL_MOUSEBUTTONUP:
@@ -128,10 +252,10 @@ InputManager::waitForInput(fd_set& fdSet,
         down = false;
         ev.type = TouchEvent::Up;
         ev.location = { x, y };
-        result.push_back(ev);
+        out.push_back(ev);
       }
       break;
   }
-  return result;
+  return NoError{};
 }
 } // namespace rmlib::input
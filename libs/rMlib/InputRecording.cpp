@@ -0,0 +1,321 @@
+#include "InputRecording.h"
+
+#include <linux/input.h>
+
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+namespace rmlib::input {
+
+namespace {
+
+constexpr char magic[4] = { 'R', 'M', 'I', 'R' };
+constexpr uint32_t version = 1;
+
+/// Marks a device record, other records start with the device id.
+constexpr uint8_t device_tag = 0xff;
+
+template<typename T>
+void
+writeValue(std::ostream& stream, T value) {
+  stream.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template<typename T>
+bool
+readValue(std::istream& stream, T& value) {
+  return bool(stream.read(reinterpret_cast<char*>(&value), sizeof(T)));
+}
+
+std::chrono::microseconds
+toDuration(const timeval& time) {
+  return std::chrono::seconds(time.tv_sec) +
+         std::chrono::microseconds(time.tv_usec);
+}
+
+timeval
+toTimeval(std::chrono::steady_clock::time_point time) {
+  const auto usecs = std::chrono::duration_cast<std::chrono::microseconds>(
+                       time.time_since_epoch())
+                       .count();
+  return timeval{ time_t(usecs / 1000000), suseconds_t(usecs % 1000000) };
+}
+
+} // namespace
+
+ErrorOr<std::unique_ptr<InputRecorder>>
+InputRecorder::create(const char* path) {
+  std::ofstream file(path, std::ios::binary);
+  if (!file.is_open()) {
+    return Error{ "Couldn't open '" + std::string(path) + "' for writing" };
+  }
+
+  file.write(magic, sizeof(magic));
+  writeValue(file, version);
+
+  return std::unique_ptr<InputRecorder>(new InputRecorder(std::move(file)));
+}
+
+InputRecorder::~InputRecorder() {
+  detach();
+}
+
+void
+InputRecorder::attach(InputManager& manager) {
+  detach();
+  this->manager = &manager;
+  manager.setRawEventHook(
+    [this](const auto& device, const auto* events, auto count) {
+      record(device, events, count);
+    });
+}
+
+void
+InputRecorder::detach() {
+  if (manager != nullptr) {
+    manager->setRawEventHook(nullptr);
+    manager = nullptr;
+  }
+}
+
+void
+InputRecorder::record(const InputDeviceBase& device,
+                      const input_event* events,
+                      std::size_t count) {
+  auto it = deviceIds.find(&device);
+  if (it == deviceIds.end()) {
+    if (deviceIds.size() >= device_tag) {
+      return;
+    }
+
+    const auto id = uint8_t(deviceIds.size());
+    it = deviceIds.emplace(&device, id).first;
+
+    const auto transform = device.getTransform();
+    writeValue(file, device_tag);
+    writeValue(file, id);
+    writeValue(file, uint8_t(device.getType()));
+    for (const auto& row : transform.matrix) {
+      writeValue(file, row[0]);
+      writeValue(file, row[1]);
+    }
+    writeValue(file, int32_t(transform.offset.x));
+    writeValue(file, int32_t(transform.offset.y));
+    writeValue(file, uint16_t(device.path.size()));
+    file.write(device.path.data(), std::streamsize(device.path.size()));
+  }
+
+  for (std::size_t i = 0; i < count; i++) {
+    const auto& event = events[i];
+    const auto time = toDuration(event.time);
+    const auto delta =
+      lastTime.has_value()
+        ? std::clamp<int64_t>((time - *lastTime).count(),
+                              0,
+                              std::numeric_limits<uint32_t>::max())
+        : 0;
+    lastTime = time;
+
+    writeValue(file, it->second);
+    writeValue(file, uint8_t(event.type));
+    writeValue(file, uint16_t(event.code));
+    writeValue(file, int32_t(event.value));
+    writeValue(file, uint32_t(delta));
+    eventCount++;
+  }
+}
+
+ErrorOr<std::unique_ptr<InputReplayer>>
+InputReplayer::open(const char* path) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file.is_open()) {
+    return Error{ "Couldn't open '" + std::string(path) + "'" };
+  }
+
+  char fileMagic[sizeof(magic)];
+  uint32_t fileVersion = 0;
+  if (!file.read(fileMagic, sizeof(fileMagic)) ||
+      std::memcmp(fileMagic, magic, sizeof(magic)) != 0 ||
+      !readValue(file, fileVersion) || fileVersion != version) {
+    return Error{ "'" + std::string(path) + "' is not an input recording" };
+  }
+
+  auto result = std::unique_ptr<InputReplayer>(new InputReplayer());
+  auto time = std::chrono::microseconds(0);
+
+  uint8_t tag = 0;
+  while (readValue(file, tag)) {
+    if (tag == device_tag) {
+      uint8_t id = 0;
+      uint8_t type = 0;
+      Transform transform;
+      int32_t offsetX = 0;
+      int32_t offsetY = 0;
+      uint16_t pathSize = 0;
+
+      auto ok = readValue(file, id) && readValue(file, type);
+      for (auto& row : transform.matrix) {
+        ok = ok && readValue(file, row[0]) && readValue(file, row[1]);
+      }
+      ok = ok && readValue(file, offsetX) && readValue(file, offsetY) &&
+           readValue(file, pathSize) && file.ignore(pathSize);
+      if (!ok || type > uint8_t(InputType::Key)) {
+        return Error{ "Invalid device in recording" };
+      }
+      transform.offset = { offsetX, offsetY };
+
+      if (result->devices.size() <= id) {
+        result->devices.resize(id + 1);
+      }
+      result->devices[id] = makeVirtualDevice(InputType(type), transform);
+      continue;
+    }
+
+    uint8_t type = 0;
+    uint16_t code = 0;
+    int32_t value = 0;
+    uint32_t delta = 0;
+    if (!readValue(file, type) || !readValue(file, code) ||
+        !readValue(file, value) || !readValue(file, delta)) {
+      return Error{ "Truncated recording" };
+    }
+
+    if (tag >= result->devices.size() || result->devices[tag] == nullptr) {
+      return Error{ "Event for unknown device in recording" };
+    }
+
+    time += std::chrono::microseconds(delta);
+    result->records.push_back(Record{ tag, type, code, value, time });
+  }
+
+  return result;
+}
+
+InputReplayer::~InputReplayer() {
+  if (manager != nullptr) {
+    manager->removeFd(timerFd);
+  }
+  if (timerFd >= 0) {
+    close(timerFd);
+  }
+}
+
+OptError<>
+InputReplayer::start(InputManager& manager, float speed) {
+  if (this->manager != nullptr) {
+    return Error{ "Already replaying" };
+  }
+
+  timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (timerFd < 0) {
+    return Error::errn();
+  }
+
+  if (auto err = manager.addEventSource(
+        timerFd, [this](std::vector<Event>& out) { onTimer(out); });
+      err.isError()) {
+    return err.getError();
+  }
+
+  this->manager = &manager;
+  this->speed = speed;
+  next = 0;
+  startTime = std::chrono::steady_clock::now();
+  armTimer();
+
+  return NoError{};
+}
+
+void
+InputReplayer::decodeAll(std::vector<Event>& out) {
+  const auto now = std::chrono::steady_clock::now();
+  for (const auto& record : records) {
+    decode(record, now + record.time, out);
+  }
+}
+
+std::vector<InputReplayer::Stream>
+InputReplayer::getStreams() const {
+  std::vector<Stream> result;
+  for (const auto& device : devices) {
+    result.push_back(device != nullptr
+                       ? Stream{ device->getType(), device->getTransform(), {} }
+                       : Stream{ InputType::Key, {}, {} });
+  }
+
+  for (const auto& record : records) {
+    auto event = input_event{};
+    event.type = record.type;
+    event.code = record.code;
+    event.value = record.value;
+    event.time = toTimeval(
+      std::chrono::steady_clock::time_point(record.time));
+    result[record.device].events.push_back(event);
+  }
+
+  return result;
+}
+
+void
+InputReplayer::decode(const Record& record,
+                      std::chrono::steady_clock::time_point time,
+                      std::vector<Event>& out) {
+  auto event = input_event{};
+  event.type = record.type;
+  event.code = record.code;
+  event.value = record.value;
+  event.time = toTimeval(time);
+  devices[record.device]->decodeEvents(&event, 1, out);
+}
+
+void
+InputReplayer::onTimer(std::vector<Event>& out) {
+  uint64_t expirations = 0;
+  read(timerFd, &expirations, sizeof(expirations));
+
+  const auto now = std::chrono::steady_clock::now();
+  for (; next < records.size(); next++) {
+    const auto& record = records[next];
+    const auto time = getDueTime(record);
+    if (time > now) {
+      break;
+    }
+    decode(record, time, out);
+  }
+
+  armTimer();
+}
+
+std::chrono::steady_clock::time_point
+InputReplayer::getDueTime(const Record& record) const {
+  if (speed == 0) {
+    return startTime;
+  }
+  return startTime +
+         std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+           record.time / speed);
+}
+
+void
+InputReplayer::armTimer() {
+  auto spec = itimerspec{};
+  if (!isDone()) {
+    const auto due = getDueTime(records[next]);
+    const auto nsecs = std::max<int64_t>(
+      1,
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+        due.time_since_epoch())
+        .count());
+    spec.it_value.tv_sec = time_t(nsecs / 1000000000);
+    spec.it_value.tv_nsec = long(nsecs % 1000000000);
+  }
+
+  // A zero value disarms the timer once all events are replayed.
+  timerfd_settime(timerFd, TFD_TIMER_ABSTIME, &spec, nullptr);
+}
+
+} // namespace rmlib::input
@@ -0,0 +1,81 @@
+#include "Input.h"
+
+namespace rmlib::input {
+
+void
+PalmFilter::filter(std::vector<Event>& events, std::size_t begin) {
+  auto kept = begin;
+
+  for (auto i = begin; i < events.size(); i++) {
+    auto& event = events[i];
+
+    if (const auto* pen = std::get_if<PenEvent>(&event)) {
+      if (pen->type == PenEvent::ToolLeave) {
+        penNear = false;
+        penLeaveTime = pen->time;
+      } else {
+        penNear = true;
+      }
+    } else if (auto* touch = std::get_if<TouchEvent>(&event)) {
+      if (!accept(*touch)) {
+        stats.droppedEvents++;
+        continue;
+      }
+    }
+
+    if (kept != i) {
+      events[kept] = event;
+    }
+    kept++;
+  }
+
+  events.erase(events.begin() + kept, events.end());
+}
+
+bool
+PalmFilter::accept(TouchEvent& event) {
+  if (event.slot < 0 || event.slot >= max_num_slots) {
+    return true;
+  }
+
+  const auto bit = 1U << event.slot;
+  const auto isLarge =
+    options.maxTouchSize > 0 && event.size > options.maxTouchSize;
+
+  if (event.isDown()) {
+    rejectedSlots &= ~bit;
+
+    if (options.rejectWhilePenNear &&
+        (penNear || event.time < penLeaveTime + options.penLeaveDelay)) {
+      stats.penNearTouches++;
+      rejectedSlots |= bit;
+      return false;
+    }
+
+    if (isLarge) {
+      stats.largeTouches++;
+      rejectedSlots |= bit;
+      return false;
+    }
+
+    return true;
+  }
+
+  if ((rejectedSlots & bit) != 0) {
+    if (event.isUp()) {
+      rejectedSlots &= ~bit;
+    }
+    return false;
+  }
+
+  if (event.isMove() && isLarge) {
+    // The palm landed on the finger, end the touch for the app.
+    stats.largeTouches++;
+    rejectedSlots |= bit;
+    event.type = TouchEvent::Up;
+  }
+
+  return true;
+}
+
+} // namespace rmlib::input
@@ -0,0 +1,204 @@
+#include "Stroke.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace rmlib {
+
+namespace {
+
+void
+fillDisk(Canvas& canvas, Point center, int radius, int val) {
+  for (int dy = -radius; dy <= radius; dy++) {
+    const auto dx = int(std::sqrt(float(radius * radius - dy * dy)));
+    const auto y = center.y + dy;
+    canvas.fill({ { center.x - dx, y }, { center.x + dx, y } }, val);
+  }
+}
+
+Rect
+segmentRect(Point from, Point to, int width) {
+  const auto margin = width / 2 + 1;
+  return Rect{ { std::min(from.x, to.x) - margin,
+                 std::min(from.y, to.y) - margin },
+               { std::max(from.x, to.x) + margin,
+                 std::max(from.y, to.y) + margin } };
+}
+
+} // namespace
+
+StrokeRenderer::StrokeRenderer(const fb::FrameBuffer& fb,
+                               StrokeOptions options)
+  : frameBuffer(fb), canvas(fb.canvas), options(options) {
+  pending.reserve(options.batchSize);
+
+  if (options.predictionTime.count() != 0) {
+    const auto maxWidth = std::max(options.minWidth, options.maxWidth);
+    const auto size =
+      segmentRect({ 0, 0 },
+                  { options.maxPredictionDistance,
+                    options.maxPredictionDistance },
+                  maxWidth)
+        .size();
+    predictionBackup.emplace(size.width, size.height, canvas.components());
+  }
+}
+
+StrokeRenderer::Sample
+StrokeRenderer::makeSample(const input::PenEvent& event) const {
+  const auto pressure = std::clamp(event.pressure, 0, options.maxPressure);
+  const auto width =
+    options.minWidth +
+    (options.maxWidth - options.minWidth) * pressure / options.maxPressure;
+  return Sample{ event.location, width, event.time };
+}
+
+void
+StrokeRenderer::handleEvent(const input::PenEvent& event) {
+  switch (event.type) {
+    case input::PenEvent::TouchDown: {
+      erasePrediction();
+      velocityX = 0;
+      velocityY = 0;
+
+      const auto sample = makeSample(event);
+      drawSegment(sample, sample);
+      last = sample;
+      break;
+    }
+
+    case input::PenEvent::Move: {
+      if (!last.has_value()) {
+        // Hovering.
+        return;
+      }
+      erasePrediction();
+
+      const auto sample = makeSample(event);
+      drawSegment(*last, sample);
+
+      // Exponential smoothing, the samples are noisy at high rates.
+      const auto dt =
+        std::chrono::duration<float>(sample.time - last->time).count();
+      if (dt > 0) {
+        const auto delta = sample.location - last->location;
+        velocityX = 0.5F * velocityX + 0.5F * float(delta.x) / dt;
+        velocityY = 0.5F * velocityY + 0.5F * float(delta.y) / dt;
+      }
+
+      last = sample;
+      break;
+    }
+
+    case input::PenEvent::TouchUp:
+      if (!last.has_value()) {
+        return;
+      }
+      erasePrediction();
+      drawSegment(*last, makeSample(event));
+      last.reset();
+      flush();
+      return;
+
+    case input::PenEvent::ToolClose:
+    case input::PenEvent::ToolLeave:
+      return;
+  }
+
+  if (int(pending.size()) >= options.batchSize) {
+    flush();
+  }
+}
+
+void
+StrokeRenderer::flush() {
+  if (!dirty.has_value()) {
+    return;
+  }
+
+  drawPrediction();
+
+  frameBuffer.doUpdate(*dirty, fb::Waveform::DU, fb::UpdateFlags::None);
+  dirty.reset();
+
+  const auto now = std::chrono::steady_clock::now();
+  for (const auto& time : pending) {
+    latency.add(
+      std::chrono::duration_cast<std::chrono::microseconds>(now - time));
+  }
+  pending.clear();
+}
+
+void
+StrokeRenderer::drawSegment(const Sample& from, const Sample& to) {
+  const auto width = std::max(from.width, to.width);
+  if (from.location != to.location) {
+    canvas.drawLine(from.location, to.location, options.color, to.width);
+  }
+  // Round caps, so consecutive segments join without gaps.
+  fillDisk(canvas, to.location, to.width / 2, options.color);
+
+  addDirty(segmentRect(from.location, to.location, width));
+  pending.push_back(to.time);
+}
+
+void
+StrokeRenderer::drawPrediction() {
+  if (!last.has_value() || !predictionBackup.has_value()) {
+    return;
+  }
+
+  const auto seconds =
+    std::chrono::duration<float>(options.predictionTime).count();
+  auto dx = velocityX * seconds;
+  auto dy = velocityY * seconds;
+
+  const auto length = std::sqrt(dx * dx + dy * dy);
+  if (length < 1) {
+    return;
+  }
+  if (length > float(options.maxPredictionDistance)) {
+    const auto scale = float(options.maxPredictionDistance) / length;
+    dx *= scale;
+    dy *= scale;
+  }
+
+  const auto from = last->location;
+  const auto to = from + Point{ int(dx), int(dy) };
+  const auto rect = segmentRect(from, to, last->width) & canvas.rect();
+  if (rect.width() <= 0 || rect.height() <= 0) {
+    return;
+  }
+
+  copy(predictionBackup->canvas, { 0, 0 }, canvas, rect);
+  predictionRect = rect;
+
+  canvas.drawLine(from, to, options.color, last->width);
+  fillDisk(canvas, to, last->width / 2, options.color);
+  addDirty(rect);
+}
+
+void
+StrokeRenderer::erasePrediction() {
+  if (!predictionRect.has_value()) {
+    return;
+  }
+
+  copy(canvas,
+       predictionRect->topLeft,
+       predictionBackup->canvas,
+       *predictionRect - predictionRect->topLeft);
+  addDirty(*predictionRect);
+  predictionRect.reset();
+}
+
+void
+StrokeRenderer::addDirty(Rect rect) {
+  rect = rect & canvas.rect();
+  if (rect.width() <= 0 || rect.height() <= 0) {
+    return;
+  }
+  dirty = dirty.has_value() ? (*dirty | rect) : rect;
+}
+
+} // namespace rmlib
@@ -0,0 +1,271 @@
+#pragma once
+
+#include "MathUtil.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <type_traits>
+
+namespace rmlib {
+
+constexpr uint16_t
+greyToRGB565(uint8_t grey) {
+  return (grey >> 3) | ((grey >> 2) << 5) | ((grey >> 3) << 11);
+}
+
+/// Returns the grey value of an RGB565 pixel, based on its green channel as
+/// that one has the most precision.
+constexpr uint8_t
+rgb565ToGrey(uint16_t pixel) {
+  const auto green = (pixel >> 5) & 0x3f;
+  return uint8_t((green << 2) | (green >> 4));
+}
+
+/// Pixel formats usable with `BasicCanvas`.
+///
+/// Each format defines the type holding a single pixel value, the number of
+/// bits a pixel takes in memory and conversions from and to 8 bit grey.
+namespace pixel {
+
+struct Grey8 {
+  using value_type = uint8_t;
+  static constexpr int bits_per_pixel = 8;
+
+  static constexpr uint8_t toGrey(value_type v) { return v; }
+  static constexpr value_type fromGrey(uint8_t grey) { return grey; }
+};
+
+struct RGB565 {
+  using value_type = uint16_t;
+  static constexpr int bits_per_pixel = 16;
+
+  static constexpr uint8_t toGrey(value_type v) { return rgb565ToGrey(v); }
+  static constexpr value_type fromGrey(uint8_t grey) {
+    return greyToRGB565(grey);
+  }
+};
+
+/// Stored as R, G, B, A bytes.
+struct RGBA8888 {
+  using value_type = uint32_t;
+  static constexpr int bits_per_pixel = 32;
+
+  static constexpr uint8_t toGrey(value_type v) {
+    const auto r = v & 0xff;
+    const auto g = (v >> 8) & 0xff;
+    const auto b = (v >> 16) & 0xff;
+    return uint8_t((r * 77 + g * 150 + b * 29) >> 8);
+  }
+  static constexpr value_type fromGrey(uint8_t grey) {
+    return 0xff000000 | (grey * 0x010101U);
+  }
+};
+
+/// Two pixels per byte, the first one in the high nibble. Values are 0-15,
+/// matching the grey levels of the panel.
+struct Grey4 {
+  using value_type = uint8_t;
+  static constexpr int bits_per_pixel = 4;
+
+  static constexpr uint8_t toGrey(value_type v) { return v * 0x11; }
+  static constexpr value_type fromGrey(uint8_t grey) { return grey >> 4; }
+};
+
+} // namespace pixel
+
+/// A view on pixel memory with a pixel format known at compile time.
+///
+/// `Canvas` is the type erased version of this. Use `Canvas::visit` to get the
+/// matching `BasicCanvas` for hot loops.
+template<typename Format>
+class BasicCanvas {
+public:
+  using format = Format;
+  using value_type = typename Format::value_type;
+
+  static constexpr bool is_packed = Format::bits_per_pixel < 8;
+  static constexpr int bytes_per_pixel = Format::bits_per_pixel / 8;
+
+  static constexpr int minLineSize(int width) {
+    return (width * Format::bits_per_pixel + 7) / 8;
+  }
+
+  BasicCanvas() = default;
+  BasicCanvas(uint8_t* mem, int width, int height)
+    : BasicCanvas(mem, width, height, minLineSize(width)) {}
+  BasicCanvas(uint8_t* mem, int width, int height, int stride)
+    : memory(mem), mWidth(width), mHeight(height), mLineSize(stride) {}
+
+  int width() const { return mWidth; }
+  int height() const { return mHeight; }
+  int lineSize() const { return mLineSize; }
+  int totalSize() const { return mLineSize * mHeight; }
+  uint8_t* getMemory() const { return memory; }
+
+  Rect rect() const { return { { 0, 0 }, { mWidth - 1, mHeight - 1 } }; }
+
+  uint8_t* getLine(int y) const { return memory + y * mLineSize; }
+
+  /// \returns A pointer to the pixels of row y, only for non packed formats.
+  value_type* getRow(int y) const {
+    static_assert(!is_packed, "Packed formats have no pixel pointers");
+    return reinterpret_cast<value_type*>(getLine(y));
+  }
+
+  value_type getPixel(int x, int y) const {
+    assert(rect().contains(Point{ x, y }));
+    if constexpr (is_packed) {
+      const auto byte = getLine(y)[x / 2];
+      return (x & 1) != 0 ? (byte & 0xf) : (byte >> 4);
+    } else {
+      return getRow(y)[x];
+    }
+  }
+
+  void setPixel(Point p, value_type value) {
+    assert(rect().contains(p));
+    if constexpr (is_packed) {
+      auto& byte = getLine(p.y)[p.x / 2];
+      byte = (p.x & 1) != 0 ? (byte & 0xf0) | (value & 0xf)
+                           : (byte & 0x0f) | (value << 4);
+    } else {
+      getRow(p.y)[p.x] = value;
+    }
+  }
+
+  void set(Rect r, value_type value) {
+    assert(rect().contains(r));
+    for (int y = r.topLeft.y; y <= r.bottomRight.y; y++) {
+      if constexpr (is_packed) {
+        int x = r.topLeft.x;
+        if ((x & 1) != 0 && x <= r.bottomRight.x) {
+          setPixel({ x, y }, value);
+          x++;
+        }
+
+        const auto bytes = (r.bottomRight.x + 1 - x) / 2;
+        std::fill_n(getLine(y) + x / 2, bytes, uint8_t(value * 0x11));
+        x += bytes * 2;
+
+        if (x <= r.bottomRight.x) {
+          setPixel({ x, y }, value);
+        }
+      } else {
+        std::fill_n(getRow(y) + r.topLeft.x, r.width(), value);
+      }
+    }
+  }
+
+  void set(value_type value) { set(rect(), value); }
+
+  template<typename Func>
+  void transform(Func&& f, Rect r) {
+    assert(rect().contains(r));
+    for (int y = r.topLeft.y; y <= r.bottomRight.y; y++) {
+      for (int x = r.topLeft.x; x <= r.bottomRight.x; x++) {
+        if constexpr (is_packed) {
+          setPixel({ x, y }, f(x, y, getPixel(x, y)));
+        } else {
+          auto* pixel = getRow(y) + x;
+          *pixel = f(x, y, *pixel);
+        }
+      }
+    }
+  }
+
+  template<typename Func>
+  void forEach(Func&& f, Rect r) const {
+    assert(rect().contains(r));
+    for (int y = r.topLeft.y; y <= r.bottomRight.y; y++) {
+      for (int x = r.topLeft.x; x <= r.bottomRight.x; x++) {
+        f(x, y, getPixel(x, y));
+      }
+    }
+  }
+
+private:
+  uint8_t* memory = nullptr;
+
+  int mWidth = 0;
+  int mHeight = 0;
+  int mLineSize = 0;
+};
+
+namespace details {
+
+template<typename From, typename To>
+void
+convertRow(const BasicCanvas<From>& src,
+           int srcX,
+           int srcY,
+           BasicCanvas<To>& dst,
+           int dstX,
+           int dstY,
+           int width) {
+  using SrcCanvas = BasicCanvas<From>;
+  using DstCanvas = BasicCanvas<To>;
+
+  if constexpr (!SrcCanvas::is_packed && !DstCanvas::is_packed) {
+    const auto* in = src.getRow(srcY) + srcX;
+    auto* out = dst.getRow(dstY) + dstX;
+    if constexpr (std::is_same_v<From, To>) {
+      std::copy_n(in, width, out);
+    } else {
+      std::transform(in, in + width, out, [](auto pixel) {
+        return To::fromGrey(From::toGrey(pixel));
+      });
+    }
+  } else if constexpr (!SrcCanvas::is_packed &&
+                       std::is_same_v<To, pixel::Grey4>) {
+    // Write full bytes where possible, the common case for the panel.
+    const auto* in = src.getRow(srcY) + srcX;
+    int x = 0;
+    if (((dstX + x) & 1) != 0 && x < width) {
+      dst.setPixel({ dstX + x, dstY }, To::fromGrey(From::toGrey(in[x])));
+      x++;
+    }
+
+    auto* out = dst.getLine(dstY) + (dstX + x) / 2;
+    for (; x + 1 < width; x += 2) {
+      const auto a = To::fromGrey(From::toGrey(in[x]));
+      const auto b = To::fromGrey(From::toGrey(in[x + 1]));
+      *out++ = uint8_t((a << 4) | b);
+    }
+
+    if (x < width) {
+      dst.setPixel({ dstX + x, dstY }, To::fromGrey(From::toGrey(in[x])));
+    }
+  } else {
+    for (int x = 0; x < width; x++) {
+      const auto grey = From::toGrey(src.getPixel(srcX + x, srcY));
+      dst.setPixel({ dstX + x, dstY }, To::fromGrey(grey));
+    }
+  }
+}
+
+} // namespace details
+
+/// Converts the pixels in `srcRect` to the format of `dest`, going through
+/// grey.
+template<typename From, typename To>
+void
+convert(BasicCanvas<To>& dest,
+        const Point& destOffset,
+        const BasicCanvas<From>& src,
+        const Rect& srcRect) {
+  assert(src.rect().contains(srcRect));
+  assert(dest.rect().contains(srcRect - srcRect.topLeft + destOffset));
+
+  for (int y = srcRect.topLeft.y; y <= srcRect.bottomRight.y; y++) {
+    details::convertRow(src,
+                        srcRect.topLeft.x,
+                        y,
+                        dest,
+                        destOffset.x,
+                        destOffset.y + y - srcRect.topLeft.y,
+                        srcRect.width());
+  }
+}
+
+} // namespace rmlib
@@ -1,8 +1,11 @@
 #pragma once
 
+#include "BasicCanvas.h"
 #include "MathUtil.h"
 
+#include <algorithm>
 #include <cassert>
+#include <cmath>
 #include <cstdint>
 #include <cstring>
 #include <memory>
@@ -40,6 +43,42 @@ public:
     , mComponents(components)
     , mLineSize(stride) {}
 
+  template<typename Format>
+  Canvas(const BasicCanvas<Format>& other)
+    : Canvas(other.getMemory(),
+             other.width(),
+             other.height(),
+             other.lineSize(),
+             BasicCanvas<Format>::bytes_per_pixel) {
+    static_assert(!BasicCanvas<Format>::is_packed,
+                  "Packed formats can't be type erased");
+  }
+
+  /// \returns A view with the given pixel format, which must match.
+  template<typename Format>
+  BasicCanvas<Format> as() const {
+    static_assert(!BasicCanvas<Format>::is_packed,
+                  "Packed formats can't be type erased");
+    assert(BasicCanvas<Format>::bytes_per_pixel == mComponents);
+    return BasicCanvas<Format>(memory, mWidth, mHeight, mLineSize);
+  }
+
+  /// Calls `f` with the `BasicCanvas` matching the pixel format of this
+  /// canvas. So the per pixel size dispatch happens once instead of for every
+  /// pixel.
+  template<typename Func>
+  decltype(auto) visit(Func&& f) const {
+    switch (mComponents) {
+      case 1:
+        return f(as<pixel::Grey8>());
+      case 4:
+        return f(as<pixel::RGBA8888>());
+      default:
+        assert(mComponents == 2 && "Unsupported pixel format");
+        return f(as<pixel::RGB565>());
+    }
+  }
+
   int totalSize() const { return mLineSize * mHeight; }
 
   Rect rect() const { return { { 0, 0 }, { mWidth - 1, mHeight - 1 } }; }
@@ -61,20 +100,7 @@ public:
   template<typename Func>
   void transform(Func&& f, Rect r) {
     assert(rect().contains(r));
-    switch (mComponents) {
-      case 1:
-        transformImpl<uint8_t>(std::forward<Func>(f), r);
-        break;
-      case 2:
-        transformImpl<uint16_t>(std::forward<Func>(f), r);
-        break;
-      case 3:
-        assert(false && "TODO");
-        break;
-      case 4:
-        transformImpl<uint32_t>(std::forward<Func>(f), r);
-        break;
-    }
+    visit([&f, &r](auto canvas) { canvas.transform(f, r); });
   }
 
   template<typename Func>
@@ -85,15 +111,7 @@ public:
   template<typename Func>
   void forEach(Func&& func, Rect r) const {
     assert(rect().contains(r.bottomRight) && rect().contains(r.topLeft));
-    for (int y = r.topLeft.y; y <= r.bottomRight.y; y++) {
-      for (int x = r.topLeft.x; x <= r.bottomRight.x; x++) {
-        auto* pixel = &memory[y * mLineSize + x * mComponents];
-        int value = 0;
-
-        memcpy(&value, pixel, mComponents);
-        func(x, y, value);
-      }
-    }
+    visit([&func, &r](auto canvas) { canvas.forEach(func, r); });
   }
 
   template<typename Func>
@@ -103,7 +121,9 @@ public:
 
   void set(Rect r, int value) {
     assert(rect().contains(r));
-    transform([value](auto x, auto y, auto v) { return value; }, r);
+    visit([&r, value](auto canvas) {
+      canvas.set(r, static_cast<typename decltype(canvas)::value_type>(value));
+    });
   }
 
   void set(int value) { set(rect(), value); }
@@ -117,15 +137,40 @@ public:
                 int bg = white,
                 std::optional<Rect> clipRect = std::nullopt);
 
-  void drawLine(Point start, Point end, int val);
+  /// Fills the part of the rect that lies inside the canvas.
+  void fill(Rect r, int value) {
+    r = r & rect();
+    if (r.width() > 0 && r.height() > 0) {
+      set(r, value);
+    }
+  }
 
-  void drawRectangle(Point topLeft, Point bottomRight, int val) {
-    drawLine(topLeft, Point{ bottomRight.x, topLeft.y }, val);
-    drawLine(topLeft, Point{ topLeft.x, bottomRight.y }, val);
-    drawLine(bottomRight, Point{ bottomRight.x, topLeft.y }, val);
-    drawLine(bottomRight, Point{ topLeft.x, bottomRight.y }, val);
+  /// Draws a line, clipped to the canvas. Thick lines are centered on the
+  /// line between start and end.
+  void drawLine(Point start, Point end, int val, int thickness = 1);
+
+  /// Draws an anti-aliased line by blending `val` into the canvas.
+  void drawLineAA(Point start, Point end, int val);
+
+  /// Draws the outline of a rectangle, the border grows inwards when thick.
+  void drawRectangle(Point topLeft,
+                     Point bottomRight,
+                     int val,
+                     int thickness = 1) {
+    const auto t = thickness;
+    fill({ topLeft, { bottomRight.x, topLeft.y + t - 1 } }, val);
+    fill({ { topLeft.x, bottomRight.y - t + 1 }, bottomRight }, val);
+    fill({ { topLeft.x, topLeft.y + t },
+           { topLeft.x + t - 1, bottomRight.y - t } },
+         val);
+    fill({ { bottomRight.x - t + 1, topLeft.y + t },
+           { bottomRight.x, bottomRight.y - t } },
+         val);
   }
 
+  void fillRoundedRectangle(Rect r, int radius, int val);
+  void drawRoundedRectangle(Rect r, int radius, int val, int thickness = 1);
+
   template<typename T = uint8_t>
   const T* getPtr(int x, int y) const {
     assert(sizeof(T) == 1 || sizeof(T) == mComponents);
@@ -171,17 +216,6 @@ public:
   bool operator!=(const Canvas& other) const { return !(*this == other); }
 
 private:
-  template<typename ValueType, typename Func>
-  void transformImpl(Func&& f, Rect r) {
-    for (int y = r.topLeft.y; y <= r.bottomRight.y; y++) {
-      for (int x = r.topLeft.x; x <= r.bottomRight.x; x++) {
-        ValueType* pixel = reinterpret_cast<ValueType*>(
-          &memory[y * mLineSize + x * sizeof(ValueType)]);
-        *pixel = f(x, y, *pixel);
-      }
-    }
-  }
-
   uint8_t* memory = nullptr;
 
   int mWidth = 0;
@@ -190,9 +224,50 @@ private:
   int mLineSize = 0;
 };
 
+/// Rasterizes an anti-aliased line using Wu's algorithm. Calls `plot(Point,
+/// coverage)` for every touched pixel, with coverage between 0 and 0xff.
+template<typename Plot>
+void
+rasterizeLineAA(Point start, Point end, Plot&& plot) {
+  const bool steep = std::abs(end.y - start.y) > std::abs(end.x - start.x);
+  if (steep) {
+    std::swap(start.x, start.y);
+    std::swap(end.x, end.y);
+  }
+  if (start.x > end.x) {
+    std::swap(start, end);
+  }
+
+  const auto doPlot = [&](int x, int y, float coverage) {
+    const auto value = static_cast<uint8_t>(coverage * 0xff + 0.5f);
+    if (value != 0) {
+      plot(steep ? Point{ y, x } : Point{ x, y }, value);
+    }
+  };
+
+  const int dx = end.x - start.x;
+  const float gradient = dx == 0 ? 1.0f : float(end.y - start.y) / float(dx);
+
+  // The end points are on pixel centers, so they're fully covered.
+  float y = float(start.y);
+  for (int x = start.x; x <= end.x; x++) {
+    const auto yInt = static_cast<int>(std::floor(y));
+    const auto frac = y - float(yInt);
+    doPlot(x, yInt, 1.0f - frac);
+    doPlot(x, yInt + 1, frac);
+    y += gradient;
+  }
+}
+
 struct ImageCanvas {
   static std::optional<ImageCanvas> load(const char* path,
                                          int background = white);
+
+  /// Loads the image, shrinking it by an integer factor while converting so
+  /// it fits in `maxSize`. No full size RGB565 copy is made.
+  static std::optional<ImageCanvas> load(const char* path,
+                                         Size maxSize,
+                                         int background = white);
   static std::optional<ImageCanvas> load(uint8_t* data,
                                          int size,
                                          int background = white);
@@ -229,14 +304,24 @@ struct MemoryCanvas {
   Canvas canvas;
 };
 
+/// Copies the pixels in `srcRect` to `dest`, converting them if the pixel
+/// formats differ.
 inline void
 copy(Canvas& dest,
      const Point& destOffset,
      const Canvas& src,
      const Rect& srcRect) {
-  assert(dest.components() == src.components());
   assert(src.rect().contains(srcRect));
-  assert(dest.rect().contains(srcRect + destOffset));
+  assert(dest.rect().contains(srcRect - srcRect.topLeft + destOffset));
+
+  if (dest.components() != src.components()) {
+    dest.visit([&](auto destCanvas) {
+      src.visit([&](const auto& srcCanvas) {
+        convert(destCanvas, destOffset, srcCanvas, srcRect);
+      });
+    });
+    return;
+  }
 
   for (int y = srcRect.topLeft.y; y <= srcRect.bottomRight.y; y++) {
     auto* srcPixel = src.getPtr<>(srcRect.topLeft.x, y);
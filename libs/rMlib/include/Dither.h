@@ -0,0 +1,39 @@
+#pragma once
+
+#include "Canvas.h"
+#include "FrameBuffer.h"
+
+namespace rmlib {
+
+enum class Dither {
+  /// Round every pixel to the nearest level.
+  None,
+
+  /// Ordered dithering using a 4x4 Bayer matrix. Fast and stable, so redrawing
+  /// part of an image gives the same result as redrawing all of it.
+  Bayer,
+
+  /// Floyd-Steinberg error diffusion. Looks better for photos, but the result
+  /// depends on the region that is quantized.
+  ErrorDiffusion,
+};
+
+/// Returns the number of grey levels the panel can show using the given
+/// waveform.
+constexpr int
+getWaveformLevels(fb::Waveform waveform) {
+  return waveform == fb::Waveform::DU ? 2 : 16;
+}
+
+/// Quantizes the pixels in the given region of the canvas to `levels` evenly
+/// spaced grey levels, using the given dithering method. Works on all pixel
+/// formats of `Canvas`, so also on grey offscreen canvases.
+void
+quantize(Canvas& canvas, Rect region, int levels, Dither dither);
+
+inline void
+quantize(Canvas& canvas, Rect region, fb::Waveform waveform, Dither dither) {
+  quantize(canvas, region, getWaveformLevels(waveform), dither);
+}
+
+} // namespace rmlib
@@ -5,13 +5,18 @@
 
 #include <algorithm>
 #include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
 #include <memory>
 #include <optional>
 #include <unordered_map>
 #include <unordered_set>
+#include <utility>
 #include <variant>
 #include <vector>
 
+struct input_event;
 struct libevdev;
 struct udev;
 struct udev_monitor;
@@ -27,6 +32,12 @@ struct TouchEvent {
   Point location;
   int pressure;
 
+  /// Size of the contact in device units, 0 if the device doesn't report it.
+  int size = 0;
+
+  /// When the event happened, as reported by the kernel.
+  std::chrono::steady_clock::time_point time;
+
   constexpr bool isDown() const { return type == Down; }
   constexpr bool isUp() const { return type == Up; }
   constexpr bool isMove() const { return type == Move; }
@@ -41,6 +52,9 @@ struct PenEvent {
 
   int id = -1234;
 
+  /// When the event happened, as reported by the kernel.
+  std::chrono::steady_clock::time_point time;
+
   constexpr bool isDown() const { return type == TouchDown; }
   constexpr bool isUp() const { return type == TouchUp; }
   constexpr bool isMove() const { return type == Move; }
@@ -49,6 +63,9 @@ struct PenEvent {
 struct KeyEvent {
   enum { Release = 0, Press = 1, Repeat = 2 } type;
   int keyCode;
+
+  /// When the event happened, as reported by the kernel.
+  std::chrono::steady_clock::time_point time;
 };
 
 template<typename T>
@@ -61,6 +78,10 @@ struct SwipeGesture {
   Point startPosition;
   Point endPosition;
   int fingers;
+
+  /// Velocity of the fingers when they were lifted, in pixels per second.
+  float velocityX = 0;
+  float velocityY = 0;
 };
 
 struct PinchGesture {
@@ -68,6 +89,9 @@ struct PinchGesture {
   Direction direction;
   Point position;
   int fingers;
+
+  /// Distance between the fingers relative to the start, below 1 for `In`.
+  float scale = 1;
 };
 
 struct TapGesture {
@@ -79,6 +103,14 @@ using Gesture = std::variant<SwipeGesture, PinchGesture, TapGesture>;
 
 using Event = std::variant<TouchEvent, PenEvent, KeyEvent>;
 
+enum class InputType { Touch, Pen, Key };
+
+struct InputDeviceBase;
+
+/// Called with the raw events of a device before they are decoded.
+using RawEventHook = std::function<void(
+  const InputDeviceBase& device, const input_event* events, std::size_t count)>;
+
 struct InputDeviceBase {
   int fd;
   libevdev* evdev;
@@ -88,15 +120,94 @@ struct InputDeviceBase {
   void ungrab();
   virtual void flood() = 0;
 
+  virtual InputType getType() const = 0;
+  virtual Transform getTransform() const { return {}; }
+
   virtual ~InputDeviceBase();
 
+  /// Reads all pending events, appending them to `out`.
   virtual OptError<> readEvents(std::vector<Event>& out) = 0;
 
+  /// Decodes raw evdev events, appending the resulting events to `out`.
+  /// Doesn't allocate, unless `out` needs to grow.
+  virtual void decodeEvents(const input_event* events,
+                            std::size_t count,
+                            std::vector<Event>& out) = 0;
+
+  /// Set for all devices using `InputManager::setRawEventHook`.
+  RawEventHook rawEventHook;
+
 protected:
   InputDeviceBase(int fd, libevdev* evdev, std::string path)
     : fd(fd), evdev(evdev), path(std::move(path)) {}
 };
 
+/// Creates a device that isn't backed by an evdev node, useful for replaying
+/// recorded input. Events can be fed to it using `decodeEvents`, or written to
+/// \p fd as raw `input_event`s to be read by `readEvents`. Takes ownership of
+/// \p fd, which should be non-blocking.
+std::unique_ptr<InputDeviceBase>
+makeVirtualDevice(InputType type, Transform transform = {}, int fd = -1);
+
+struct PalmFilterOptions {
+  /// Reject touches that start while the pen is in range.
+  bool rejectWhilePenNear = true;
+
+  /// Keep rejecting new touches for this long after the pen left.
+  std::chrono::milliseconds penLeaveDelay = std::chrono::milliseconds(300);
+
+  /// Touches with a larger contact size are palms, 0 to disable.
+  /// In device units, see `TouchEvent::size`.
+  int maxTouchSize = 0;
+};
+
+struct PalmFilterStats {
+  /// Touches that were rejected, by reason.
+  int penNearTouches = 0;
+  int largeTouches = 0;
+
+  /// Touch events that were dropped.
+  int droppedEvents = 0;
+};
+
+/// Drops the touches of a palm resting on the screen while writing.
+/// A touch is accepted or rejected when it starts, all its events follow that
+/// decision. An accepted touch that grows too large is ended with an up event.
+class PalmFilter {
+public:
+  explicit PalmFilter(PalmFilterOptions options) : options(options) {}
+
+  /// Filters the events from `begin` on in place, without allocating.
+  /// Pen events are used to track the pen, and are kept.
+  void filter(std::vector<Event>& events, std::size_t begin = 0);
+
+  const PalmFilterStats& getStats() const { return stats; }
+  const PalmFilterOptions& getOptions() const { return options; }
+
+private:
+  bool accept(TouchEvent& event);
+
+  PalmFilterOptions options;
+  PalmFilterStats stats;
+
+  bool penNear = false;
+  std::chrono::steady_clock::time_point penLeaveTime;
+
+  /// Bit i is set if the touch in slot i was rejected.
+  uint32_t rejectedSlots = 0;
+  static_assert(max_num_slots <= 32, "Rejected slots must fit in the mask");
+};
+
+/// Collapses consecutive moves of each touch slot and of the pen into the
+/// latest one, for the events from `begin` on. Down and up events are kept,
+/// and a move is never moved past a down or up of the same slot.
+/// Works in place without allocating, returns the number of dropped moves.
+std::size_t
+coalesceMoves(std::vector<Event>& events, std::size_t begin = 0);
+
+struct InputReader;
+struct DeviceScan;
+
 struct BaseDevices {
   InputDeviceBase& pen;
   InputDeviceBase& touch;
@@ -104,12 +215,20 @@ struct BaseDevices {
 };
 
 struct InputManager {
+  using FdCallback = std::function<void()>;
+  using EventSource = std::function<void(std::vector<Event>& out)>;
+
   ErrorOr<InputDeviceBase*> open(std::string_view input,
                                  Transform inputTransform);
 
   ErrorOr<InputDeviceBase*> open(std::string_view input);
 
+  /// Closes the device, if it's open.
+  void close(std::string_view input);
+
   /// Opens all devices for the current device type.
+  /// The base devices are opened directly, other devices are found by a scan
+  /// in the background and opened by a later `waitForInput`.
   /// \param monitor If true monitor for new devices and automatically add them.
   ///                Will also remove devices when unplugged.
   ErrorOr<BaseDevices> openAll(bool monitor = true);
@@ -117,56 +236,71 @@ struct InputManager {
   InputManager();
   ~InputManager();
 
-  InputManager(InputManager&& other) : devices(std::move(other.devices)) {
-    other.devices.clear();
-  }
-
-  InputManager& operator=(InputManager&& other) {
-    devices.clear();
-    std::swap(other, *this);
-    return *this;
-  }
+  InputManager(InputManager&& other);
+  InputManager& operator=(InputManager&& other);
 
   InputManager(const InputManager&) = delete;
   InputManager& operator=(const InputManager&) = delete;
 
-  ErrorOr<std::vector<Event>> waitForInput(
-    fd_set& fdSet,
-    int maxFd,
-    std::optional<std::chrono::microseconds> timeout = std::nullopt);
-
-  template<typename... ExtraFds>
-  auto waitForInput(std::optional<std::chrono::microseconds> timeout,
-                    ExtraFds... extraFds)
-    -> ErrorOr<std::conditional_t<
-      sizeof...(ExtraFds) == 0,
-      std::vector<Event>,
-      std::pair<std::vector<Event>, std::array<bool, sizeof...(ExtraFds)>>>> {
-    static_assert((std::is_same_v<ExtraFds, int> && ...));
-
-    fd_set fds;
-    FD_ZERO(&fds);
-    if constexpr (sizeof...(ExtraFds) > 0) {
-      constexpr auto fd_set = [](auto fd, auto& fds) { FD_SET(fd, &fds); };
-      (fd_set(extraFds, fds), ...);
+  /// Watches an extra fd, like a pty or timerfd. The callback is called from
+  /// `waitForInput` when the fd becomes readable.
+  /// \param edgeTriggered Only call the callback when new data arrives, the
+  ///                      callback must then read until EAGAIN.
+  OptError<> addFd(int fd, FdCallback callback, bool edgeTriggered = false) {
+    return addEventSource(
+      fd,
+      [callback = std::move(callback)](std::vector<Event>&) { callback(); },
+      edgeTriggered);
+  }
+
+  /// Like `addFd`, but the callback can add events, which are returned by
+  /// `waitForInput` as if they came from a device.
+  OptError<> addEventSource(int fd,
+                            EventSource source,
+                            bool edgeTriggered = false);
+
+  /// Removes an fd added by `addFd` or `addEventSource`.
+  void removeFd(int fd);
+
+  /// Passes the raw events of all devices, current and future, to the hook.
+  /// Must be set before `startInputThread`, the hook is then called on the
+  /// input thread.
+  void setRawEventHook(RawEventHook hook);
+
+  /// Rejects palm touches in `waitForInput`, see `PalmFilter`.
+  /// Pass `std::nullopt` to disable it again.
+  void setPalmFilter(std::optional<PalmFilterOptions> options) {
+    if (options.has_value()) {
+      palmFilter.emplace(*options);
+    } else {
+      palmFilter.reset();
     }
+  }
 
-    auto maxFd = std::max({ 0, extraFds... });
+  const PalmFilter* getPalmFilter() const {
+    return palmFilter.has_value() ? &*palmFilter : nullptr;
+  }
 
-    auto res = TRY(waitForInput(fds, maxFd, timeout));
-    if constexpr (sizeof...(ExtraFds) == 0) {
-      return res;
-    } else {
-      std::array<bool, sizeof...(extraFds)> extraResult;
-      int i = 0;
+  /// Reads the devices on a separate high priority thread from now on.
+  /// The events are queued with their kernel timestamps and returned by
+  /// `waitForInput`, so reading input doesn't wait for slow frames. No events
+  /// are dropped, the thread stops reading while the queue is full.
+  OptError<> startInputThread();
 
-      constexpr auto fd_isset = [](auto fd, auto& fds) {
-        return FD_ISSET(fd, &fds);
-      };
-      ((extraResult[i++] = fd_isset(extraFds, fds)), ...);
+  /// Waits for input on any of the devices or extra fds.
+  /// The events of all devices that had input are appended to `out`, so the
+  /// same buffer can be reused without allocating. Callbacks of extra fds are
+  /// called before returning.
+  OptError<> waitForInput(std::vector<Event>& out,
+                          std::optional<std::chrono::microseconds> timeout);
 
-      return std::pair{ res, extraResult };
+  ErrorOr<std::vector<Event>> waitForInput(
+    std::optional<std::chrono::microseconds> timeout = std::nullopt) {
+    std::vector<Event> result;
+    if (auto err = waitForInput(result, timeout); err.isError()) {
+      return err.getError();
     }
+    return result;
   }
 
   std::optional<BaseDevices> getBaseDevices() const { return baseDevices; }
@@ -176,10 +310,51 @@ struct InputManager {
     devices;
 
 private:
+  /// Starts reading an opened device.
+  ErrorOr<InputDeviceBase*> add(std::unique_ptr<InputDeviceBase> device);
+
+  OptError<> watch(int fd, bool edgeTriggered);
+  void unwatch(int fd);
+  void finishScan();
+
   std::optional<BaseDevices> baseDevices;
   udev* udevHandle = nullptr;
   udev_monitor* udevMonitor = nullptr;
   int udevMonitorFd = -1;
+
+  int epollFd = -1;
+  std::unordered_map<int, InputDeviceBase*> deviceFds;
+  // Boxed, so a callback can remove its own fd while it runs, see `removeFd`.
+  std::unordered_map<int, std::unique_ptr<EventSource>> fdCallbacks;
+  std::vector<std::unique_ptr<EventSource>> removedCallbacks;
+  bool inFdCallback = false;
+  RawEventHook rawEventHook;
+  std::optional<PalmFilter> palmFilter;
+
+  /// Set when the devices are read on a separate thread.
+  std::unique_ptr<InputReader> inputReader;
+
+  /// Set while the other devices are being enumerated.
+  std::unique_ptr<DeviceScan> deviceScan;
+};
+
+/// Continuous state of the fingers on the screen, updated once per report.
+struct GestureProgress {
+  int fingers = 0;
+  Point centroid;
+
+  /// Average distance of the fingers to the centroid.
+  float spread = 0;
+
+  /// Spread relative to the start of the gesture.
+  float scale = 1;
+
+  /// Rotation since the start of the gesture, in radians, clockwise.
+  float rotation = 0;
+
+  /// Smoothed velocity of the centroid, in pixels per second.
+  float velocityX = 0;
+  float velocityY = 0;
 };
 
 struct GestureController {
@@ -192,6 +367,9 @@ struct GestureController {
     Point currentPos;
     Point startPos;
     std::chrono::steady_clock::time_point time;
+
+    /// Position when the number of fingers last changed.
+    Point basePos;
   };
 
   Gesture getGesture(Point currentDelta);
@@ -199,14 +377,31 @@ struct GestureController {
   void handleTouchMove(const TouchEvent& event);
   std::optional<Gesture> handleTouchUp(const TouchEvent& event);
 
+  /// Handles a single touch event, returns the gesture if one finished.
+  /// Doesn't allocate.
+  std::optional<Gesture> handleEvent(const TouchEvent& event);
+
   std::pair<std::vector<Gesture>, std::vector<Event>> handleEvents(
     const std::vector<Event>& events);
 
   void sync(InputDeviceBase& device);
 
+  /// The state after the last complete report, for animating a gesture while
+  /// it's in progress. A report is complete once an event of the next one is
+  /// handled, or at the end of `handleEvents`.
+  const GestureProgress& getProgress() const { return progress; }
+
+  /// The gesture being performed, if one was detected.
+  const Gesture* getStartedGesture() const {
+    return started ? &gesture : nullptr;
+  }
+
   void reset() {
     started = false;
     tapFingers = 0;
+    progress = {};
+    baseFingers = 0;
+    dirty = false;
   }
 
   int getCurrentFingers() {
@@ -221,6 +416,24 @@ struct GestureController {
 
   bool started = false;
   Gesture gesture;
+
+private:
+  void updateProgress();
+
+  GestureProgress progress;
+
+  // The scale and rotation are relative to this baseline, which is reset
+  // when fingers are added or removed so the centroid doesn't jump.
+  int baseFingers = 0;
+  Point baseCentroid;
+  float baseSpread = 0;
+  float baseScale = 1;
+  float baseRotation = 0;
+
+  /// Set when slots changed since the last `updateProgress`.
+  bool dirty = false;
+  std::chrono::steady_clock::time_point reportTime;
+  std::chrono::steady_clock::time_point lastUpdate;
 };
 
 } // namespace rmlib::input
@@ -0,0 +1,112 @@
+#pragma once
+
+#include "Error.h"
+#include "Input.h"
+
+#include <linux/input.h>
+
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace rmlib::input {
+
+/// Records the raw events of all devices of an `InputManager` to a file.
+///
+/// The file starts with a magic and a version, followed by records. A device
+/// record describes a device the first time it sends events. An event record
+/// holds a single evdev event, the device it came from and the time since the
+/// previous event, so a record is only 12 bytes.
+class InputRecorder {
+public:
+  static ErrorOr<std::unique_ptr<InputRecorder>> create(const char* path);
+
+  ~InputRecorder();
+
+  /// Records all devices of the manager from now on. The recorder must outlive
+  /// the manager or be detached first.
+  void attach(InputManager& manager);
+  void detach();
+
+  void record(const InputDeviceBase& device,
+              const input_event* events,
+              std::size_t count);
+
+  int getEventCount() const { return eventCount; }
+
+private:
+  InputRecorder(std::ofstream file) : file(std::move(file)) {}
+
+  std::ofstream file;
+  InputManager* manager = nullptr;
+
+  std::unordered_map<const InputDeviceBase*, uint8_t> deviceIds;
+  std::optional<std::chrono::microseconds> lastTime;
+  int eventCount = 0;
+};
+
+/// Feeds a recording made by `InputRecorder` to an `InputManager`, as if the
+/// events came from real devices. This allows running input handling
+/// repeatably, without a touchscreen.
+class InputReplayer {
+public:
+  static ErrorOr<std::unique_ptr<InputReplayer>> open(const char* path);
+
+  ~InputReplayer();
+
+  /// Starts replaying the events through `waitForInput` of the manager.
+  /// \param speed How much faster than real time to replay. Zero replays all
+  ///              events at once.
+  OptError<> start(InputManager& manager, float speed = 1);
+
+  /// Decodes all events at once, without going through a manager.
+  void decodeAll(std::vector<Event>& out);
+
+  /// The raw events of a single recorded device.
+  struct Stream {
+    InputType type;
+    Transform transform;
+    std::vector<input_event> events;
+  };
+
+  /// Splits the recording per device, for feeding it to devices made by
+  /// `makeVirtualDevice`. Event times are relative to the recording start.
+  std::vector<Stream> getStreams() const;
+
+  bool isDone() const { return next == records.size(); }
+  std::size_t getEventCount() const { return records.size(); }
+
+private:
+  struct Record {
+    uint8_t device;
+    uint16_t type;
+    uint16_t code;
+    int32_t value;
+
+    /// Time since the start of the recording.
+    std::chrono::microseconds time;
+  };
+
+  InputReplayer() = default;
+
+  void decode(const Record& record,
+              std::chrono::steady_clock::time_point time,
+              std::vector<Event>& out);
+  std::chrono::steady_clock::time_point getDueTime(const Record& record) const;
+  void onTimer(std::vector<Event>& out);
+  void armTimer();
+
+  std::vector<std::unique_ptr<InputDeviceBase>> devices;
+  std::vector<Record> records;
+  std::size_t next = 0;
+
+  InputManager* manager = nullptr;
+  int timerFd = -1;
+  float speed = 1;
+  std::chrono::steady_clock::time_point startTime;
+};
+
+} // namespace rmlib::input
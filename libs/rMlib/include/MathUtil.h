@@ -185,6 +185,12 @@ struct Rect {
     return *this;
   }
 
+  constexpr Rect& operator-=(const Point& p) {
+    topLeft -= p;
+    bottomRight -= p;
+    return *this;
+  }
+
   constexpr Rect& operator|=(const Rect& other) {
     topLeft = { std::min(topLeft.x, other.topLeft.x),
                 std::min(topLeft.y, other.topLeft.y) };
@@ -216,6 +222,16 @@ struct Rect {
 static_assert(Rect{}.width() == 0);
 static_assert(Rect{}.height() == 0);
 
+constexpr bool
+operator==(const Rect& a, const Rect& b) {
+  return a.topLeft == b.topLeft && a.bottomRight == b.bottomRight;
+}
+
+constexpr bool
+operator!=(const Rect& a, const Rect& b) {
+  return !(a == b);
+}
+
 constexpr Rect
 operator&(const Rect& a, const Rect& b) {
   return Rect{ { std::max(a.topLeft.x, b.topLeft.x),
@@ -242,6 +258,12 @@ operator+(const Point& p, Rect r) {
   return r;
 }
 
+constexpr Rect
+operator-(Rect r, const Point& p) {
+  r -= p;
+  return r;
+}
+
 template<typename T>
 std::basic_ostream<char, T>&
 operator<<(std::basic_ostream<char, T>& os, const Rect& r) {
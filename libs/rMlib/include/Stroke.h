@@ -0,0 +1,118 @@
+#pragma once
+
+#include "Canvas.h"
+#include "FrameBuffer.h"
+#include "Input.h"
+
+#include <chrono>
+#include <optional>
+#include <vector>
+
+namespace rmlib {
+
+/// Time from the kernel timestamp of an input event until the update showing
+/// it was sent to the display.
+struct LatencyStats {
+  int samples = 0;
+  std::chrono::microseconds total{ 0 };
+  std::chrono::microseconds min = std::chrono::microseconds::max();
+  std::chrono::microseconds max{ 0 };
+
+  void add(std::chrono::microseconds latency) {
+    samples++;
+    total += latency;
+    min = std::min(min, latency);
+    max = std::max(max, latency);
+  }
+
+  std::chrono::microseconds mean() const {
+    return samples == 0 ? std::chrono::microseconds(0) : total / samples;
+  }
+};
+
+struct StrokeOptions {
+  int color = black;
+
+  /// Width of the stroke at zero and full pressure, in pixels.
+  int minWidth = 2;
+  int maxWidth = 6;
+  int maxPressure = 4095;
+
+  /// Number of pen samples to draw before sending an update. Updates are also
+  /// sent by `StrokeRenderer::flush`.
+  int batchSize = 4;
+
+  /// Extends the stroke this far into the future based on the pen velocity,
+  /// to hide part of the display latency. The prediction is erased again when
+  /// the real samples arrive. Zero disables it.
+  std::chrono::milliseconds predictionTime{ 12 };
+
+  /// Limits the length of the predicted segment, in pixels.
+  int maxPredictionDistance = 24;
+};
+
+/// Draws pen strokes directly into the framebuffer, with DU updates of only
+/// the area that changed. This bypasses the widget tree, so ink shows up
+/// without waiting for a rebuild, layout and draw.
+///
+/// The strokes aren't part of any widget, so apps should keep the strokes they
+/// care about and draw them again when the region gets redrawn.
+class StrokeRenderer {
+public:
+  StrokeRenderer(const fb::FrameBuffer& fb, StrokeOptions options);
+  explicit StrokeRenderer(const fb::FrameBuffer& fb)
+    : StrokeRenderer(fb, StrokeOptions{}) {}
+
+  /// Draws the event if the pen is touching the screen.
+  void handleEvent(const input::PenEvent& event);
+
+  /// Sends an update for everything drawn since the last update. Call this
+  /// after handling all events returned by `waitForInput`.
+  void flush();
+
+  bool isDrawing() const { return last.has_value(); }
+
+  const LatencyStats& getLatency() const { return latency; }
+  void resetLatency() { latency = {}; }
+
+private:
+  struct Sample {
+    Point location;
+    int width;
+    std::chrono::steady_clock::time_point time;
+  };
+
+  Sample makeSample(const input::PenEvent& event) const;
+
+  void drawSegment(const Sample& from, const Sample& to);
+  void drawPrediction();
+  void erasePrediction();
+  void addDirty(Rect rect);
+
+  const fb::FrameBuffer& frameBuffer;
+  Canvas canvas;
+  StrokeOptions options;
+
+  /// The last sample of the current stroke, unset while the pen is up.
+  std::optional<Sample> last;
+
+  /// Smoothed pen velocity, in pixels per second.
+  float velocityX = 0;
+  float velocityY = 0;
+
+  /// The pixels under the predicted segment, in the top left corner. Large
+  /// enough for the longest prediction, so drawing one doesn't allocate.
+  std::optional<MemoryCanvas> predictionBackup;
+
+  /// The rect of the predicted segment, unset if none is drawn.
+  std::optional<Rect> predictionRect;
+
+  std::optional<Rect> dirty;
+
+  /// Timestamps of the samples drawn since the last update.
+  std::vector<std::chrono::steady_clock::time_point> pending;
+
+  LatencyStats latency;
+};
+
+} // namespace rmlib
@@ -13,12 +13,18 @@
 #include <UI/Gesture.h>
 #include <UI/Image.h>
 #include <UI/Layout.h>
+#include <UI/RepaintBoundary.h>
 #include <UI/Text.h>
 
 #include <UI/AppContext.h>
+#include <UI/AppOptions.h>
+#include <UI/FrameStats.h>
+#include <UI/Profiler.h>
 #include <UI/Util.h>
 
 #include <csignal>
+#include <cstdlib>
+#include <string_view>
 
 /// Ideas: (most stolen from flutter)
 // * Widgets are cheap to create, so have no real state.
@@ -29,23 +35,44 @@ namespace rmlib {
 
 namespace details {
 static AppContext* currentContext = nullptr;
+static volatile std::sig_atomic_t dumpStats = 0;
 
 void
 stop(int signal) {
   currentContext->stop();
 }
 
+void
+requestStats(int signal) {
+  dumpStats = 1;
+}
+
 } // namespace details
 
 template<typename AppWidget>
 OptError<>
-runApp(AppWidget widget) {
+runApp(AppWidget widget, AppOptions options = {}) {
   auto fb = TRY(rmlib::fb::FrameBuffer::open());
 
-  AppContext context(fb.canvas);
+  std::optional<MemoryCanvas> greyCanvas;
+  if (options.greyCanvas) {
+    greyCanvas.emplace(fb.canvas.width(), fb.canvas.height(), 1);
+    greyCanvas->canvas.set(white);
+  }
+  auto& canvas = greyCanvas.has_value() ? greyCanvas->canvas : fb.canvas;
+
+  AppContext context(canvas);
   details::currentContext = &context;
 
   TRY(context.getInputManager().openAll());
+  context.getInputManager().setPalmFilter(options.palmFilter);
+  if (options.inputThread) {
+    if (auto err = context.getInputManager().startInputThread();
+        err.isError()) {
+      std::cerr << "Input thread failed, reading input on the UI thread: "
+                << err.getError().msg << std::endl;
+    }
+  }
 
   auto rootRO = widget.createRenderObject();
 
@@ -54,39 +81,133 @@ runApp(AppWidget widget) {
 
   std::signal(SIGINT, details::stop);
   std::signal(SIGTERM, details::stop);
+  std::signal(SIGUSR1, details::requestStats);
+
+  // Reused every frame, so input handling doesn't allocate.
+  std::vector<input::Event> events;
+
+  FrameStats stats;
+
+  std::optional<Profiler> profiler;
+  const char* profileEnv = std::getenv("RMLIB_PROFILE");
+  const auto profileOverlay =
+    options.profileOverlay ||
+    (profileEnv != nullptr && std::string_view(profileEnv) == "overlay");
+  if (options.profile || profileEnv != nullptr) {
+    profiler.emplace(fbSize);
+    profiler->start();
+  }
 
   while (!context.shouldStop()) {
-    rootRO->rebuild(context, nullptr);
+    const auto frameStart = std::chrono::steady_clock::now();
+
+    {
+      auto scope = FrameStats::Scope(stats, FrameStats::Rebuild);
+      rootRO->rebuild(context, nullptr);
+    }
 
-    const auto size = rootRO->layout(constraints);
+    auto size = Size{};
+    {
+      auto scope = FrameStats::Scope(stats, FrameStats::Layout);
+      size = rootRO->layout(constraints);
+    }
     const auto rect = rmlib::Rect{ { 0, 0 }, size.toPoint() };
 
-    auto updateRegion = rootRO->cleanup(fb.canvas);
-    updateRegion |= rootRO->draw(rect, fb.canvas);
+    auto updateRegion = UpdateRegion{};
+    {
+      auto scope = FrameStats::Scope(stats, FrameStats::Draw);
+      if (profiler.has_value() && profileOverlay) {
+        profiler->restoreOverlay(canvas);
+      }
+
+      updateRegion = rootRO->cleanup(canvas);
+      updateRegion |= rootRO->draw(rect, PaintContext(canvas));
+    }
+
+    // The overlay gets its own update, so it doesn't change the waveforms.
+    auto overlayRegion = UpdateRegion{};
+    if (profiler.has_value()) {
+      profiler->frameDone(updateRegion);
+      if (profileOverlay) {
+        overlayRegion = profiler->drawOverlay(canvas);
+      }
+    }
 
-    if (!updateRegion.region.empty()) {
-      fb.doUpdate(
-        updateRegion.region, updateRegion.waveform, updateRegion.flags);
+    // The overlay is updated even without other damage, so it shows the
+    // heat decaying.
+    if (!updateRegion.empty() || !overlayRegion.empty()) {
+      auto scope = FrameStats::Scope(stats, FrameStats::Update);
+      for (const auto* regions : { &updateRegion, &overlayRegion }) {
+        for (const auto& damage : *regions) {
+          if (greyCanvas.has_value()) {
+            const auto region = damage.rect & canvas.rect();
+            copy(fb.canvas, region.topLeft, canvas, region);
+          }
+
+          fb.doUpdate(damage.rect, damage.waveform, damage.flags);
+        }
+      }
     }
+    stats.frameDone();
+
+    // Wait for something to happen. With frame pacing, keep gathering input
+    // and running timers until the next frame is due, so they're drawn
+    // together.
+    const auto nextFrame = frameStart + options.frameInterval;
+    events.clear();
+    for (bool first = true;; first = false) {
+      auto timeout = context.getWaitTimeout();
+      if (!first) {
+        const auto remaining =
+          std::chrono::duration_cast<std::chrono::microseconds>(
+            nextFrame - std::chrono::steady_clock::now());
+        if (remaining <= std::chrono::microseconds(0)) {
+          break;
+        }
+        timeout = std::min(timeout.value_or(remaining), remaining);
+      }
+
+      // Appends, so all input of the frame is handled at once below.
+      const auto err = context.getInputManager().waitForInput(events, timeout);
+      context.checkTimers();
+      context.doAllLaters();
+
+      if (err.isError()) {
+        std::cerr << err.getError().msg << std::endl;
+      }
 
-    const auto duration = context.getNextDuration();
-    const auto evsOrError = context.getInputManager().waitForInput(duration);
-    context.checkTimers();
-    context.doAllLaters();
+      if (details::dumpStats != 0) {
+        details::dumpStats = 0;
+        stats.dump(std::cerr);
+        if (profiler.has_value()) {
+          profiler->dump(std::cerr);
+        }
+      }
 
-    if (evsOrError.isError()) {
-      std::cerr << evsOrError.getError().msg << std::endl;
-    } else {
-      for (const auto& ev : *evsOrError) {
-        rootRO->handleInput(ev);
+      if (options.frameInterval.count() == 0 || context.shouldStop()) {
+        break;
       }
     }
 
+    if (options.coalesceMoves) {
+      context.setInputHistory(events);
+      input::coalesceMoves(events);
+    }
+
+    for (const auto& ev : events) {
+      rootRO->handleInput(ev);
+    }
+
     rootRO->reset();
   }
 
+  if (profiler.has_value()) {
+    profiler->dump(std::cerr);
+  }
+
   std::signal(SIGINT, SIG_DFL);
   std::signal(SIGTERM, SIG_DFL);
+  std::signal(SIGUSR1, SIG_DFL);
   details::currentContext = nullptr;
 
   return NoError{};
@@ -1,52 +1,106 @@
 #pragma once
 
 #include <Input.h>
+#include <UI/Executor.h>
 #include <UI/Timer.h>
 
+#include <algorithm>
+#include <cstdio>
 #include <vector>
 
+#ifndef __APPLE__
+#include <sys/timerfd.h>
+#include <unistd.h>
+#endif
+
 namespace rmlib {
 
 class AppContext {
 public:
-  AppContext(Canvas& fbCanvas) : canvas(fbCanvas) {}
+  AppContext(Canvas& canvas) : canvas(canvas) {
+    if (executor.getWakeFd() >= 0) {
+      inputManager.addFd(executor.getWakeFd(),
+                         [this] { executor.runCompletions(); });
+    }
+
+#ifndef __APPLE__
+    timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timerFd < 0) {
+      perror("Error creating timer fd");
+      return;
+    }
+
+    auto err = inputManager.addFd(timerFd, [this] {
+      uint64_t expirations = 0;
+      [[maybe_unused]] auto ret =
+        read(timerFd, &expirations, sizeof(expirations));
+      armedDeadline = std::nullopt;
+    });
+    if (err.isError()) {
+      close(timerFd);
+      timerFd = -1;
+    }
+#endif
+  }
+
+  ~AppContext() {
+    if (executor.getWakeFd() >= 0) {
+      inputManager.removeFd(executor.getWakeFd());
+    }
+
+#ifndef __APPLE__
+    if (timerFd >= 0) {
+      inputManager.removeFd(timerFd);
+      close(timerFd);
+    }
+#endif
+  }
+
+  AppContext(const AppContext&) = delete;
+  AppContext& operator=(const AppContext&) = delete;
 
   TimerHandle addTimer(
     std::chrono::microseconds duration,
     Callback trigger,
     std::optional<std::chrono::microseconds> repeat = std::nullopt) {
-    auto [timer, handle] =
-      Timer::makeTimer(duration, std::move(trigger), repeat);
-    timers.emplace(std::move(timer));
-    return std::move(handle);
+    return timers.add(duration, std::move(trigger), repeat);
   }
 
-  std::optional<std::chrono::microseconds> getNextDuration() const {
-    if (timers.empty()) {
+  /// Prepares waiting for input. The timer fd wakes the wait when the next
+  /// timer is due, without one the returned timeout must be used instead.
+  std::optional<std::chrono::microseconds> getWaitTimeout() {
+    const auto deadline = timers.getNextDeadline();
+
+#ifndef __APPLE__
+    if (timerFd >= 0) {
+      armTimerFd(deadline);
       return std::nullopt;
     }
+#endif
 
-    auto duration = timers.top()->getDuration();
-    if (duration < std::chrono::microseconds(0)) {
-      return std::chrono::microseconds(0);
+    if (!deadline.has_value()) {
+      return std::nullopt;
     }
-    return duration;
+
+    return std::max(std::chrono::microseconds(0),
+                    std::chrono::duration_cast<std::chrono::microseconds>(
+                      *deadline - TimerWheel::clock::now()));
   }
 
-  void checkTimers() {
-    while (!timers.empty()) {
-      std::shared_ptr<Timer> top = timers.top();
-      if (top->check()) {
-        timers.pop();
-
-        if (top->repeats()) {
-          top->reset();
-          timers.emplace(std::move(top));
-        }
-      } else {
-        break;
-      }
-    }
+  void checkTimers() { timers.advance(); }
+
+  /// Calls \p func on a background thread, see `Executor::runAsync`. Use this
+  /// for blocking work, so the UI keeps responding.
+  template<typename Func>
+  auto runAsync(Func func) {
+    return executor.runAsync(std::move(func));
+  }
+
+  /// Like `runAsync`, but the continuation is dropped with \p handle, see
+  /// `TaskHandle`.
+  template<typename Func>
+  auto runAsync(TaskHandle& handle, Func func) {
+    return executor.runAsync(handle, std::move(func));
   }
 
   void stop() { mShouldStop = true; }
@@ -63,12 +117,55 @@ public:
 
   input::InputManager& getInputManager() { return inputManager; }
 
-  const Canvas& getFbCanvas() const { return canvas; }
+  /// All input events of the current frame, including the moves dropped by
+  /// `AppOptions::coalesceMoves`. Empty if moves aren't coalesced.
+  const std::vector<input::Event>& getInputHistory() const {
+    return inputHistory;
+  }
+
+  void setInputHistory(const std::vector<input::Event>& events) {
+    // Assigning keeps the capacity, so this doesn't allocate every frame.
+    inputHistory = events;
+  }
+
+  /// The canvas the widgets draw into. This is the framebuffer, unless the app
+  /// draws into a grey canvas, see `AppOptions::greyCanvas`.
+  const Canvas& getCanvas() const { return canvas; }
 
 private:
+#ifndef __APPLE__
+  void armTimerFd(std::optional<TimerWheel::clock::time_point> deadline) {
+    if (deadline == armedDeadline) {
+      return;
+    }
+
+    // The steady clock is the monotonic clock, an all zero value disarms.
+    auto spec = itimerspec{};
+    if (deadline.has_value()) {
+      const auto time = deadline->time_since_epoch();
+      const auto secs = std::chrono::duration_cast<std::chrono::seconds>(time);
+      spec.it_value.tv_sec = secs.count();
+      spec.it_value.tv_nsec =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(time - secs)
+          .count();
+    }
+
+    if (timerfd_settime(timerFd, TFD_TIMER_ABSTIME, &spec, nullptr) < 0) {
+      perror("Error arming timer fd");
+      return;
+    }
+    armedDeadline = deadline;
+  }
+
+  int timerFd = -1;
+  std::optional<TimerWheel::clock::time_point> armedDeadline;
+#endif
+
   input::InputManager inputManager;
-  TimerQueue timers;
+  TimerWheel timers;
+  Executor executor;
   std::vector<Callback> doLaters;
+  std::vector<input::Event> inputHistory;
   Canvas& canvas;
 
   bool mShouldStop = false;
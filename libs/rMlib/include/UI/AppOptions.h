@@ -0,0 +1,44 @@
+#pragma once
+
+#include <Input.h>
+
+#include <chrono>
+#include <optional>
+
+namespace rmlib {
+
+/// Options for running an app, see `runApp`.
+struct AppOptions {
+  /// Draw into an offscreen 8 bit grey canvas instead of the RGB565
+  /// framebuffer. Only the updated regions are converted to the framebuffer,
+  /// which halves the memory traffic of drawing and copying.
+  bool greyCanvas = false;
+
+  /// Read input on a separate high priority thread. Events then keep their
+  /// kernel timestamps and don't queue up in the kernel during slow frames.
+  bool inputThread = false;
+
+  /// Drop palm touches while the pen is used, see `input::PalmFilter`.
+  std::optional<input::PalmFilterOptions> palmFilter;
+
+  /// Only handle the latest move of each finger and the pen per frame, so a
+  /// slow frame doesn't run the handlers for every queued move.
+  /// All events stay available with `AppContext::getInputHistory`.
+  bool coalesceMoves = false;
+
+  /// Minimum time between frames. Input and timers that arrive within it are
+  /// handled together and drawn in a single frame, instead of drawing after
+  /// each of them. Zero draws as soon as anything happened.
+  std::chrono::milliseconds frameInterval = std::chrono::milliseconds(0);
+
+  /// Record the layout and draw time and the updates of every render object
+  /// type, see `Profiler`. The summary is printed on SIGUSR1 and on exit.
+  /// Also enabled by setting the RMLIB_PROFILE environment variable.
+  bool profile = false;
+
+  /// When profiling, show a heatmap of the updates of the last frames in the
+  /// bottom right corner. Also enabled by RMLIB_PROFILE=overlay.
+  bool profileOverlay = false;
+};
+
+} // namespace rmlib
@@ -32,10 +32,10 @@ private:
       return child->cleanup(canvas);
     }
 
-    void markNeedsLayout() override {
+    void markSubtreeNeedsLayout() override {
       RenderObject::markNeedsLayout();
       if (child) {
-        child->markNeedsLayout();
+        child->markSubtreeNeedsLayout();
       }
     }
 
@@ -46,6 +46,20 @@ private:
       }
     }
 
+    void markSubtreeDrawn() override {
+      RenderObject::markSubtreeDrawn();
+      if (child) {
+        child->markSubtreeDrawn();
+      }
+    }
+
+    void moveBy(rmlib::Point delta) override {
+      RenderObject::moveBy(delta);
+      if (child) {
+        child->moveBy(delta);
+      }
+    }
+
     void rebuild(AppContext& context, const BuildContext* parent) final {
       // RenderObject::rebuild(context, parent);
       // const auto buildCtx = BuildContext{ *this, parent };
@@ -62,8 +76,8 @@ private:
       return child->layout(constraints);
     }
 
-    UpdateRegion doDraw(rmlib::Rect rect, rmlib::Canvas& canvas) override {
-      return child->draw(rect, canvas);
+    UpdateRegion doDraw(rmlib::Rect rect, const PaintContext& ctx) override {
+      return child->draw(rect, ctx);
     }
 
     bool getNeedsDraw() const override {
@@ -74,6 +88,12 @@ private:
       return RenderObject::getNeedsLayout() || child->needsLayout();
     }
 
+    bool getNeedsOwnLayout() const override {
+      return RenderObject::getNeedsOwnLayout() || childNeedsOwnLayout(*child);
+    }
+
+    void layoutChildren() override { relayout(*child); }
+
   private:
     std::unique_ptr<RenderObject> child;
   };
@@ -0,0 +1,248 @@
+#pragma once
+
+#include <UI/Future.h>
+#include <UI/Util.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifndef __APPLE__
+#include <sys/eventfd.h>
+#endif
+
+namespace rmlib {
+
+/// Owns the continuation of a task started by `Executor::runAsync`. When the
+/// handle is destroyed, or another task is assigned to it, the result of the
+/// task is dropped instead of passed to the future. Keep it in the state that
+/// the continuation uses, like a `TimerHandle`.
+class TaskHandle {
+public:
+  TaskHandle() = default;
+  ~TaskHandle() { cancel(); }
+
+  TaskHandle(TaskHandle&& other) noexcept = default;
+  TaskHandle& operator=(TaskHandle&& other) noexcept {
+    if (this != &other) {
+      cancel();
+      alive = std::move(other.alive);
+    }
+    return *this;
+  }
+
+  TaskHandle(const TaskHandle&) = delete;
+  TaskHandle& operator=(const TaskHandle&) = delete;
+
+  /// The continuation won't be called anymore, the task itself still runs.
+  void cancel() {
+    if (alive != nullptr) {
+      *alive = false;
+      alive.reset();
+    }
+  }
+
+private:
+  friend class Executor;
+
+  /// Only read and written on the UI thread.
+  std::shared_ptr<bool> alive;
+};
+
+/// Runs blocking work on a small pool of background threads. The results are
+/// passed back to the UI thread, which is woken by the fd from `getWakeFd`.
+class Executor {
+public:
+  Executor(int threads = 2) : shared(std::make_shared<Shared>(threads)) {}
+
+  /// Doesn't wait for running tasks, they can block for a long time. Their
+  /// threads are detached and their results are dropped.
+  ~Executor() {
+    {
+      std::lock_guard<std::mutex> lock(shared->mutex);
+      shared->stopping = true;
+      shared->tasks.clear();
+    }
+    shared->cond.notify_all();
+
+    for (auto& worker : workers) {
+      worker.detach();
+    }
+  }
+
+  Executor(const Executor&) = delete;
+  Executor& operator=(const Executor&) = delete;
+
+  /// Calls \p func on a background thread. It may still be running when the
+  /// executor is destroyed, so it must not use anything owned by the app.
+  /// \returns A future for the result. The value is set on the UI thread, by
+  /// `runCompletions`, so continuations can be added with `then` before
+  /// returning to the event loop.
+  template<typename Func>
+  auto runAsync(Func func) {
+    return start(std::move(func), nullptr);
+  }
+
+  /// Like `runAsync`, but the result is dropped once \p handle is destroyed,
+  /// so the continuation can use the state owning the handle.
+  template<typename Func>
+  auto runAsync(TaskHandle& handle, Func func) {
+    handle = TaskHandle{};
+    handle.alive = std::make_shared<bool>(true);
+    return start(std::move(func), handle.alive);
+  }
+
+  /// Calls the continuations of all finished tasks, on the calling thread.
+  void runCompletions() {
+    uint64_t buf[8];
+    while (read(shared->readFd, buf, sizeof(buf)) > 0) {
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(shared->mutex);
+      std::swap(shared->completions, running);
+    }
+
+    for (const auto& completion : running) {
+      completion();
+    }
+    running.clear();
+  }
+
+  /// Readable when tasks have finished, see `runCompletions`.
+  int getWakeFd() const { return shared->readFd; }
+
+private:
+  /// A task returns the callback to run on the UI thread.
+  using Task = std::function<Callback()>;
+
+  /// Shared with the workers, so detached workers can still finish.
+  struct Shared {
+    Shared(int maxThreads) : maxThreads(maxThreads) {
+#ifdef __APPLE__
+      int fds[2];
+      if (pipe(fds) == 0) {
+        readFd = fds[0];
+        writeFd = fds[1];
+        for (const auto fd : fds) {
+          fcntl(fd, F_SETFL, O_NONBLOCK);
+          fcntl(fd, F_SETFD, FD_CLOEXEC);
+        }
+      }
+#else
+      readFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+      writeFd = readFd;
+#endif
+      if (readFd < 0) {
+        perror("Error creating executor wake fd");
+      }
+    }
+
+    ~Shared() {
+      if (writeFd != readFd && writeFd >= 0) {
+        close(writeFd);
+      }
+      if (readFd >= 0) {
+        close(readFd);
+      }
+    }
+
+    int maxThreads;
+    int readFd = -1;
+    int writeFd = -1;
+
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::deque<Task> tasks;
+    std::vector<Callback> completions;
+    int idle = 0;
+    bool stopping = false;
+  };
+
+  template<typename Func>
+  auto start(Func func, std::shared_ptr<bool> alive) {
+    using Result = std::invoke_result_t<Func>;
+
+    // Shared, as std::function must be copyable.
+    auto promise = std::make_shared<Promise<Result>>();
+    auto future = promise->getFuture();
+
+    post([func = std::move(func), promise, alive]() mutable -> Callback {
+      if constexpr (std::is_void_v<Result>) {
+        func();
+        return [promise, alive] {
+          if (alive == nullptr || *alive) {
+            promise->setValue();
+          }
+        };
+      } else {
+        auto result = std::make_shared<Result>(func());
+        return [promise, alive, result] {
+          if (alive == nullptr || *alive) {
+            promise->setValue(std::move(*result));
+          }
+        };
+      }
+    });
+
+    return future;
+  }
+
+  void post(Task task) {
+    {
+      std::lock_guard<std::mutex> lock(shared->mutex);
+      shared->tasks.emplace_back(std::move(task));
+
+      // Only start threads once they're needed.
+      if (shared->idle == 0 && int(workers.size()) < shared->maxThreads) {
+        workers.emplace_back([shared = shared] { work(*shared); });
+      }
+    }
+    shared->cond.notify_one();
+  }
+
+  static void work(Shared& shared) {
+    std::unique_lock<std::mutex> lock(shared.mutex);
+    while (true) {
+      shared.idle++;
+      shared.cond.wait(
+        lock, [&shared] { return shared.stopping || !shared.tasks.empty(); });
+      shared.idle--;
+      if (shared.stopping) {
+        return;
+      }
+
+      auto task = std::move(shared.tasks.front());
+      shared.tasks.pop_front();
+
+      lock.unlock();
+      auto completion = task();
+      lock.lock();
+
+      // Nobody runs the completions anymore.
+      if (shared.stopping) {
+        return;
+      }
+      shared.completions.emplace_back(std::move(completion));
+
+      const uint64_t one = 1;
+      [[maybe_unused]] auto ret = write(shared.writeFd, &one, sizeof(one));
+    }
+  }
+
+  std::shared_ptr<Shared> shared;
+  std::vector<std::thread> workers;
+  std::vector<Callback> running;
+};
+
+} // namespace rmlib
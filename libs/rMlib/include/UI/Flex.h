@@ -87,7 +87,7 @@ protected:
     return result;
   }
 
-  UpdateRegion doDraw(rmlib::Rect rect, rmlib::Canvas& canvas) override {
+  UpdateRegion doDraw(rmlib::Rect rect, const PaintContext& ctx) override {
     UpdateRegion result;
 
     const auto maxSize = isVertical() ? rect.height() : rect.width();
@@ -108,9 +108,9 @@ protected:
       const auto subRect = rmlib::Rect{ topLeft, bottomRight };
 
       if (i == 0) {
-        result = child->draw(subRect, canvas);
+        result = child->draw(subRect, ctx);
       } else {
-        result |= child->draw(subRect, canvas);
+        result |= child->draw(subRect, ctx);
       }
       offset += isVertical() ? size.height : size.width;
     }
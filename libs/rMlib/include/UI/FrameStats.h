@@ -0,0 +1,90 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <iomanip>
+#include <ostream>
+
+namespace rmlib {
+
+/// Histograms of how long each phase of a frame took.
+class FrameStats {
+public:
+  enum Phase { Rebuild, Layout, Draw, Update, num_phases };
+
+  /// Bucket i counts durations below 2^i ms, the last one everything above.
+  static constexpr int num_buckets = 12;
+
+  struct Histogram {
+    std::array<int, num_buckets> buckets{};
+    int count = 0;
+    std::chrono::microseconds total{ 0 };
+    std::chrono::microseconds max{ 0 };
+
+    void add(std::chrono::microseconds duration) {
+      int bucket = 0;
+      while (bucket < num_buckets - 1 &&
+             duration >= std::chrono::milliseconds(1 << bucket)) {
+        bucket++;
+      }
+      buckets[bucket]++;
+      count++;
+      total += duration;
+      max = std::max(max, duration);
+    }
+  };
+
+  /// Measures a phase until the end of the scope.
+  class Scope {
+  public:
+    Scope(FrameStats& stats, Phase phase)
+      : stats(stats), phase(phase), start(std::chrono::steady_clock::now()) {}
+
+    ~Scope() {
+      stats.record(phase,
+                   std::chrono::duration_cast<std::chrono::microseconds>(
+                     std::chrono::steady_clock::now() - start));
+    }
+
+  private:
+    FrameStats& stats;
+    Phase phase;
+    std::chrono::steady_clock::time_point start;
+  };
+
+  void record(Phase phase, std::chrono::microseconds duration) {
+    histograms[phase].add(duration);
+  }
+
+  void frameDone() { frames++; }
+
+  const Histogram& get(Phase phase) const { return histograms[phase]; }
+  int getFrames() const { return frames; }
+
+  void dump(std::ostream& os) const {
+    constexpr std::array<const char*, num_phases> names = {
+      "rebuild", "layout", "draw", "update"
+    };
+
+    os << "Frames: " << frames << "\n";
+    for (int phase = 0; phase < num_phases; phase++) {
+      const auto& hist = histograms[phase];
+      const auto mean = hist.count == 0 ? 0 : hist.total.count() / hist.count;
+      os << std::setw(8) << names[phase] << ": mean " << mean << "us max "
+         << hist.max.count() << "us |";
+      for (const auto count : hist.buckets) {
+        os << " " << count;
+      }
+      os << "\n";
+    }
+    os << "Buckets: <1ms, <2ms, <4ms, ... <" << (1 << (num_buckets - 2))
+       << "ms, more" << std::endl;
+  }
+
+private:
+  std::array<Histogram, num_phases> histograms;
+  int frames = 0;
+};
+
+} // namespace rmlib
@@ -3,6 +3,8 @@
 #include <UI/RenderObject.h>
 #include <UI/Widget.h>
 
+#include <Dither.h>
+
 namespace rmlib {
 
 class ColoredRenderObject;
@@ -46,8 +48,8 @@ protected:
     return result;
   }
 
-  UpdateRegion doDraw(rmlib::Rect rect, rmlib::Canvas& canvas) override {
-    canvas.set(rect, widget->color);
+  UpdateRegion doDraw(rmlib::Rect rect, const PaintContext& ctx) override {
+    ctx.fill(rect, widget->color);
     return UpdateRegion{ rect };
   }
 };
@@ -65,10 +67,20 @@ public:
   Image(const Canvas& canvas, bool stretch = false)
     : canvas(canvas), stretch(stretch) {}
 
+  /// Quantizes the image to the levels supported by the waveform, so it can
+  /// be shown using a fast waveform without artifacts.
+  Image(const Canvas& canvas,
+        bool stretch,
+        Dither dither,
+        fb::Waveform waveform = fb::Waveform::DU)
+    : canvas(canvas), stretch(stretch), dither(dither), waveform(waveform) {}
+
   std::unique_ptr<RenderObject> createRenderObject() const;
 
   const Canvas& canvas;
   bool stretch;
+  std::optional<Dither> dither;
+  fb::Waveform waveform = fb::Waveform::GC16Fast;
 };
 
 class ImageRenderObject : public LeafRenderObject<Image> {
@@ -76,7 +88,10 @@ public:
   using LeafRenderObject<Image>::LeafRenderObject;
 
   void update(const Image& newWidget) {
-    if (newWidget.canvas != widget->canvas) {
+    if (newWidget.canvas != widget->canvas ||
+        newWidget.dither != widget->dither ||
+        newWidget.waveform != widget->waveform) {
+      cache.reset();
       markNeedsDraw();
     }
     widget = &newWidget;
@@ -92,7 +107,12 @@ protected:
                    h, constraints.min.height, constraints.max.height) };
   }
 
-  UpdateRegion doDraw(rmlib::Rect rect, rmlib::Canvas& canvas) override {
+  UpdateRegion doDraw(rmlib::Rect rect, const PaintContext& ctx) override {
+    if (cache.has_value() && cache->size == rect.size()) {
+      ctx.drawImage(cache->canvas.canvas, rect.topLeft + cache->rect.topLeft);
+      return UpdateRegion{ rect, widget->waveform };
+    }
+
     float scale_x = (float)rect.width() / widget->canvas.width();
     float scale_y = (float)rect.height() / widget->canvas.height();
     int offset_x = 0;
@@ -108,22 +128,74 @@ protected:
       }
     }
 
-    canvas.transform(
-      [&](int x, int y, int old) {
-        int subY = (y - rect.topLeft.y - offset_y) / scale_y;
-        int subX = (x - rect.topLeft.x - offset_x) / scale_x;
-        if (!widget->canvas.rect().contains(Point{ subX, subY })) {
-          return old;
+    // Only the pixels inside the clip rect are scaled.
+    auto& canvas = ctx.canvas();
+    const auto visible = ctx.clip();
+    const auto origin = rect.topLeft + ctx.offset();
+
+    canvas.visit([&](auto dest) {
+      widget->canvas.visit([&](const auto& src) {
+        using DestFormat = typename decltype(dest)::format;
+        using SrcFormat = typename std::decay_t<decltype(src)>::format;
+
+        dest.transform(
+          [&](int x, int y, auto old) {
+            int subY = (y - origin.y - offset_y) / scale_y;
+            int subX = (x - origin.x - offset_x) / scale_x;
+            if (!src.rect().contains(Point{ subX, subY })) {
+              return old;
+            }
+
+            const auto pixel = src.getPixel(subX, subY);
+            if constexpr (std::is_same_v<DestFormat, SrcFormat>) {
+              return pixel;
+            } else {
+              return DestFormat::fromGrey(SrcFormat::toGrey(pixel));
+            }
+          },
+          visible + ctx.offset());
+      });
+    });
+
+    if (widget->dither.has_value()) {
+      // Only quantize the pixels covered by the image.
+      const auto imageSize =
+        Point{ int(widget->canvas.width() * scale_x),
+               int(widget->canvas.height() * scale_y) };
+      const auto topLeft = rect.topLeft + Point{ offset_x, offset_y };
+      const auto imageRect =
+        Rect{ topLeft, topLeft + imageSize - Point{ 1, 1 } } & rect;
+
+      const auto drawRect = imageRect & visible;
+
+      if (drawRect.width() > 0 && drawRect.height() > 0) {
+        quantize(
+          canvas, drawRect + ctx.offset(), widget->waveform, *widget->dither);
+
+        // Keep the result, redraws without changes can just copy it. Only
+        // when it's complete, so not when clipped.
+        if (drawRect == imageRect) {
+          cache.emplace(
+            Cache{ rect.size(),
+                   imageRect - rect.topLeft,
+                   MemoryCanvas(canvas, imageRect + ctx.offset()) });
         }
+      }
+    }
 
-        auto pixel = widget->canvas.getPixel(subX, subY);
-        // auto* pixel = widget->canvas.getPtr(subX, subY);
-        return pixel;
-      },
-      rect);
-
-    return UpdateRegion{ rect };
+    return UpdateRegion{ rect, widget->waveform };
   }
+
+private:
+  struct Cache {
+    Size size;
+
+    /// Relative to the rect of the render object.
+    Rect rect;
+    MemoryCanvas canvas;
+  };
+
+  std::optional<Cache> cache;
 };
 
 inline std::unique_ptr<RenderObject>
@@ -37,13 +37,13 @@ public:
   }
 
 protected:
-  UpdateRegion doDraw(rmlib::Rect rect, rmlib::Canvas& canvas) override {
+  UpdateRegion doDraw(rmlib::Rect rect, const PaintContext& ctx) override {
     const auto xOffset = (rect.width() - childSize.width) / 2;
     const auto yOffset = (rect.height() - childSize.height) / 2;
 
     const auto topLeft = rect.topLeft + rmlib::Point{ xOffset, yOffset };
     const auto bottomRight = topLeft + childSize.toPoint();
-    return this->child->draw(rmlib::Rect{ topLeft, bottomRight }, canvas);
+    return this->child->draw(rmlib::Rect{ topLeft, bottomRight }, ctx);
   }
 
 private:
@@ -90,9 +90,9 @@ protected:
     return constraints.expand(childSize, this->widget->insets);
   }
 
-  UpdateRegion doDraw(rmlib::Rect rect, rmlib::Canvas& canvas) override {
+  UpdateRegion doDraw(rmlib::Rect rect, const PaintContext& ctx) override {
     const auto childRect = this->widget->insets.shrink(rect);
-    auto childRegion = this->child->draw(childRect, canvas);
+    auto childRegion = this->child->draw(childRect, ctx);
 
     return childRegion;
   }
@@ -147,34 +147,23 @@ protected:
     return newSize;
   }
 
-  UpdateRegion doDraw(rmlib::Rect rect, rmlib::Canvas& canvas) override {
-    auto result = this->child->draw(this->widget->size.shrink(rect), canvas);
+  UpdateRegion doDraw(rmlib::Rect rect, const PaintContext& ctx) override {
+    auto result = this->child->draw(this->widget->size.shrink(rect), ctx);
 
     if (this->isFullDraw()) {
-      const auto drawLine = [&canvas](Point a, Point b, Point dir, int size) {
-        for (int i = 0; i < size; i++) {
-          canvas.drawLine(a, b, black);
-          a += dir;
-          b += dir;
-        }
-      };
-
-      drawLine(rect.topLeft,
-               { rect.bottomRight.x, rect.topLeft.y },
-               { 0, 1 },
-               this->widget->size.top);
-      drawLine(rect.topLeft,
-               { rect.topLeft.x, rect.bottomRight.y },
-               { 1, 0 },
-               this->widget->size.left);
-      drawLine({ rect.bottomRight.x, rect.topLeft.y },
-               rect.bottomRight,
-               { -1, 0 },
-               this->widget->size.right);
-      drawLine({ rect.topLeft.x, rect.bottomRight.y },
-               rect.bottomRight,
-               { 0, -1 },
-               this->widget->size.bottom);
+      const auto inner = this->widget->size.shrink(rect);
+
+      ctx.fill({ rect.topLeft, { rect.bottomRight.x, inner.topLeft.y - 1 } },
+               black);
+      ctx.fill(
+        { { rect.topLeft.x, inner.bottomRight.y + 1 }, rect.bottomRight },
+        black);
+      ctx.fill({ { rect.topLeft.x, inner.topLeft.y },
+                 { inner.topLeft.x - 1, inner.bottomRight.y } },
+               black);
+      ctx.fill({ { inner.bottomRight.x + 1, inner.topLeft.y },
+                 { rect.bottomRight.x, inner.bottomRight.y } },
+               black);
 
       result |= UpdateRegion{ rect, rmlib::fb::Waveform::DU };
     }
@@ -242,8 +231,8 @@ protected:
     return childSize;
   }
 
-  UpdateRegion doDraw(rmlib::Rect rect, rmlib::Canvas& canvas) override {
-    return this->child->draw(rect, canvas);
+  UpdateRegion doDraw(rmlib::Rect rect, const PaintContext& ctx) override {
+    return this->child->draw(rect, ctx);
   }
 };
 
@@ -302,15 +291,15 @@ protected:
     return this->child->layout(constraints);
   }
 
-  UpdateRegion doDraw(rmlib::Rect rect, rmlib::Canvas& canvas) override {
+  UpdateRegion doDraw(rmlib::Rect rect, const PaintContext& ctx) override {
     auto region = UpdateRegion{};
 
     if (this->isFullDraw()) {
-      canvas.set(rect, this->widget->color);
+      ctx.fill(rect, this->widget->color);
       region = UpdateRegion{ rect };
     }
 
-    return region | this->child->draw(rect, canvas);
+    return region | this->child->draw(rect, ctx);
   }
 };
 
@@ -373,10 +362,10 @@ protected:
     return result;
   }
 
-  UpdateRegion doDraw(rmlib::Rect rect, rmlib::Canvas& canvas) override {
+  UpdateRegion doDraw(rmlib::Rect rect, const PaintContext& ctx) override {
     const auto topLeft = rect.topLeft + this->widget->position;
     const auto bottomRight = topLeft + childSize.toPoint();
-    return this->child->draw({ topLeft, bottomRight }, canvas);
+    return this->child->draw({ topLeft, bottomRight }, ctx);
   }
 
 private:
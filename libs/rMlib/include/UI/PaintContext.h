@@ -0,0 +1,135 @@
+#pragma once
+
+#include <Canvas.h>
+
+#include <algorithm>
+#include <string_view>
+
+namespace rmlib {
+
+/// Where render objects draw. Coordinates are those of the screen, the offset
+/// is added to get the pixel in the canvas. Nothing outside the clip rect is
+/// changed: each primitive is clipped once, and primitives fully outside of
+/// it are skipped.
+class PaintContext {
+public:
+  PaintContext(Canvas& canvas) : PaintContext(canvas, canvas.rect()) {}
+
+  PaintContext(Canvas& canvas, Rect clip, Point offset = { 0, 0 })
+    : mCanvas(&canvas)
+    , mClip(clip & (canvas.rect() - offset))
+    , mOffset(offset) {}
+
+  /// \returns A context that only draws in the part of \p rect inside the
+  /// current clip rect.
+  PaintContext clipped(Rect rect) const {
+    auto result = *this;
+    result.mClip = mClip & rect;
+    return result;
+  }
+
+  /// The rect that can be drawn to, in screen coordinates.
+  Rect clip() const { return mClip; }
+
+  /// The offset from screen to canvas coordinates.
+  Point offset() const { return mOffset; }
+
+  /// The canvas itself, for drawing that clips on its own. Use `clip` and
+  /// `offset` to find the pixels that may be changed.
+  Canvas& canvas() const { return *mCanvas; }
+
+  bool isVisible(Rect rect) const { return !isEmpty(rect & mClip); }
+
+  void fill(Rect rect, int value) const {
+    rect = rect & mClip;
+    if (!isEmpty(rect)) {
+      mCanvas->set(rect + mOffset, value);
+    }
+  }
+
+  void drawRectangle(Point topLeft,
+                     Point bottomRight,
+                     int value,
+                     int thickness = 1) const {
+    const auto rect = Rect{ topLeft, bottomRight };
+    if (!isVisible(rect)) {
+      return;
+    }
+    view().drawRectangle(
+      toView(topLeft), toView(bottomRight), value, thickness);
+  }
+
+  void fillRoundedRectangle(Rect rect, int radius, int value) const {
+    if (!isVisible(rect)) {
+      return;
+    }
+    view().fillRoundedRectangle(rect - mClip.topLeft, radius, value);
+  }
+
+  void drawRoundedRectangle(Rect rect,
+                            int radius,
+                            int value,
+                            int thickness = 1) const {
+    if (!isVisible(rect)) {
+      return;
+    }
+    view().drawRoundedRectangle(
+      rect - mClip.topLeft, radius, value, thickness);
+  }
+
+  void drawLine(Point start, Point end, int value, int thickness = 1) const {
+    const auto rect = Rect{ { std::min(start.x, end.x) - thickness,
+                              std::min(start.y, end.y) - thickness },
+                            { std::max(start.x, end.x) + thickness,
+                              std::max(start.y, end.y) + thickness } };
+    if (!isVisible(rect)) {
+      return;
+    }
+    view().drawLine(toView(start), toView(end), value, thickness);
+  }
+
+  void drawText(std::string_view text,
+                Point location,
+                int size = default_text_size,
+                int fg = black,
+                int bg = white) const {
+    const auto textSize = Canvas::getTextSize(text, size);
+    if (!isVisible({ location, location + textSize })) {
+      return;
+    }
+    mCanvas->drawText(
+      text, location + mOffset, size, fg, bg, mClip + mOffset);
+  }
+
+  /// Copies all of \p src to \p topLeft.
+  void drawImage(const Canvas& src, Point topLeft) const {
+    const auto rect =
+      Rect{ topLeft, topLeft + src.rect().bottomRight } & mClip;
+    if (!isEmpty(rect)) {
+      copy(*mCanvas, rect.topLeft + mOffset, src, rect - topLeft);
+    }
+  }
+
+private:
+  static bool isEmpty(Rect rect) {
+    return rect.width() <= 0 || rect.height() <= 0;
+  }
+
+  /// A canvas of only the clip rect, so the canvas primitives clip to it.
+  Canvas view() const {
+    const auto rect = mClip + mOffset;
+    return Canvas(mCanvas->getPtr(rect.topLeft.x, rect.topLeft.y),
+                  rect.width(),
+                  rect.height(),
+                  mCanvas->lineSize(),
+                  mCanvas->components());
+  }
+
+  Point toView(Point p) const { return p - mClip.topLeft; }
+
+  Canvas* mCanvas;
+  Rect mClip;
+  Point mOffset;
+};
+
+} // namespace rmlib
@@ -0,0 +1,316 @@
+#pragma once
+
+#include <UI/Util.h>
+
+#include <Canvas.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdlib>
+#include <cxxabi.h>
+#include <iomanip>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <typeindex>
+#include <typeinfo>
+#include <unordered_map>
+#include <vector>
+
+namespace rmlib {
+
+/// Records the layout and draw time of every render object, and the area and
+/// waveform of the updates it asks for, summed per render object type. Also
+/// keeps the updates of the last frames for a heatmap overlay.
+///
+/// Only the started profiler records anything, otherwise the scopes in
+/// `RenderObject` just check a pointer.
+class Profiler {
+public:
+  using clock = std::chrono::steady_clock;
+
+  enum Phase { Layout, Draw, num_phases };
+
+  /// Indexed by `fb::Waveform`.
+  static constexpr int num_waveforms = 4;
+
+  /// Screen pixels per heatmap pixel, in both directions.
+  static constexpr int heatmap_scale = 16;
+
+  struct TypeStats {
+    const std::type_info* type = nullptr;
+    std::array<int, num_phases> count{};
+
+    /// Excluding the time spent in children.
+    std::array<std::chrono::microseconds, num_phases> time{};
+
+    /// Area of the updates, excluding those of children. Parents are charged
+    /// for the area added by merging the updates of their children.
+    std::array<long, num_waveforms> area{};
+
+    std::chrono::microseconds maxDraw{ 0 };
+    int maxDrawID = -1;
+  };
+
+  /// Measures the layout or draw of a render object until the end of the
+  /// scope.
+  class Scope {
+  public:
+    template<typename RO>
+    Scope(Phase phase, const RO& ro, int id) {
+      if (current != nullptr) {
+        profiler = current;
+        profiler->push(phase, typeid(ro), id);
+      }
+    }
+
+    ~Scope() {
+      if (profiler != nullptr) {
+        profiler->pop();
+      }
+    }
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+    /// Sets the updates the render object asked for while drawing.
+    void setDamage(const UpdateRegion& region) {
+      if (profiler != nullptr) {
+        profiler->addDamage(region);
+      }
+    }
+
+  private:
+    Profiler* profiler = nullptr;
+  };
+
+  /// \param screenSize The size of the canvas, for the heatmap.
+  /// \param heatmapFrames Number of frames shown by the heatmap.
+  Profiler(Size screenSize, int heatmapFrames = 32)
+    : heatmapFrames(heatmapFrames)
+    , heatSize(screenSize / heatmap_scale)
+    , heat(heatSize.width * heatSize.height, 0) {}
+
+  ~Profiler() { stop(); }
+
+  Profiler(const Profiler&) = delete;
+  Profiler& operator=(const Profiler&) = delete;
+
+  void start() { current = this; }
+
+  void stop() {
+    if (current == this) {
+      current = nullptr;
+    }
+  }
+
+  /// Records the updates of a frame, after it was drawn.
+  void frameDone(const UpdateRegion& region) {
+    frames++;
+    for (const auto& damage : region) {
+      updates[int(damage.waveform)]++;
+      updateArea[int(damage.waveform)] += area(damage.rect);
+    }
+
+    recent.push_back(region);
+    addHeat(region, 1);
+    if (int(recent.size()) > heatmapFrames) {
+      addHeat(recent.front(), -1);
+      recent.erase(recent.begin());
+    }
+  }
+
+  /// Puts back the pixels below the overlay, must be called before drawing a
+  /// frame.
+  void restoreOverlay(Canvas& canvas) const {
+    if (saved.has_value()) {
+      copy(canvas, overlayRect.topLeft, saved->canvas, saved->canvas.rect());
+    }
+  }
+
+  /// Draws a heatmap of the updates in the last frames in the bottom right
+  /// corner. Slower waveforms count more, the darker the more updates.
+  /// \returns The region to update.
+  UpdateRegion drawOverlay(Canvas& canvas) {
+    const auto size = heatSize;
+    const auto bottomRight = canvas.rect().bottomRight;
+    overlayRect =
+      Rect{ bottomRight - size.toPoint(), bottomRight } & canvas.rect();
+    if (overlayRect.size() != size) {
+      return {};
+    }
+
+    if (!saved.has_value() ||
+        saved->canvas.components() != canvas.components()) {
+      saved.emplace(canvas, overlayRect);
+    } else {
+      copy(saved->canvas, { 0, 0 }, canvas, overlayRect);
+    }
+
+    // The weight of GC16 for every frame.
+    const auto maxHeat = 4 * heatmapFrames;
+    canvas.visit([&](auto typed) {
+      using Format = typename decltype(typed)::format;
+
+      for (int y = 0; y < size.height; y++) {
+        for (int x = 0; x < size.width; x++) {
+          const auto border =
+            x == 0 || y == 0 || x == size.width - 1 || y == size.height - 1;
+          const auto h = std::min(heat[y * size.width + x], maxHeat);
+          const auto grey = border ? 0 : 0xff - h * 0xff / maxHeat;
+          typed.setPixel(overlayRect.topLeft + Point{ x, y },
+                         Format::fromGrey(uint8_t(grey)));
+        }
+      }
+    });
+
+    return UpdateRegion{ overlayRect, fb::Waveform::DU };
+  }
+
+  void dump(std::ostream& os) const {
+    constexpr std::array<const char*, num_waveforms> names = {
+      "", "DU", "GC16", "GC16Fast"
+    };
+
+    os << "Profiled frames: " << frames << "\n";
+    for (int waveform = 1; waveform < num_waveforms; waveform++) {
+      os << std::setw(9) << names[waveform] << ": " << updates[waveform]
+         << " updates, " << updateArea[waveform] << " px\n";
+    }
+
+    std::vector<const TypeStats*> sorted;
+    sorted.reserve(types.size());
+    for (const auto& [_, stats] : types) {
+      sorted.push_back(&stats);
+    }
+    std::sort(sorted.begin(), sorted.end(), [](const auto* a, const auto* b) {
+      return a->time[Draw] > b->time[Draw];
+    });
+
+    os << "   draws  draw us  layouts layout us        DU px  GC16Fast px"
+          "      GC16 px  max draw us (id)  type\n";
+    for (const auto* stats : sorted) {
+      os << std::setw(8) << stats->count[Draw] << std::setw(9)
+         << stats->time[Draw].count() << std::setw(9) << stats->count[Layout]
+         << std::setw(10) << stats->time[Layout].count() << std::setw(13)
+         << stats->area[int(fb::Waveform::DU)] << std::setw(13)
+         << stats->area[int(fb::Waveform::GC16Fast)] << std::setw(13)
+         << stats->area[int(fb::Waveform::GC16)] << std::setw(13)
+         << stats->maxDraw.count() << " (" << stats->maxDrawID << ")  "
+         << demangle(*stats->type) << "\n";
+    }
+    os << std::flush;
+  }
+
+  const std::unordered_map<std::type_index, TypeStats>& getTypes() const {
+    return types;
+  }
+
+private:
+  struct Frame {
+    TypeStats* stats;
+    Phase phase;
+    int id;
+    clock::time_point start;
+    clock::duration childTime{ 0 };
+    std::array<long, num_waveforms> area{};
+    std::array<long, num_waveforms> childArea{};
+  };
+
+  static long area(const Rect& rect) {
+    return long(rect.width()) * rect.height();
+  }
+
+  static std::string demangle(const std::type_info& type) {
+    int status = 0;
+    char* name = abi::__cxa_demangle(type.name(), nullptr, nullptr, &status);
+    if (name == nullptr) {
+      return type.name();
+    }
+    auto result = std::string(name);
+    std::free(name); // NOLINT
+    return result;
+  }
+
+  void push(Phase phase, const std::type_info& type, int id) {
+    auto& stats = types[std::type_index(type)];
+    stats.type = &type;
+    stack.push_back(Frame{ &stats, phase, id, clock::now() });
+  }
+
+  void addDamage(const UpdateRegion& region) {
+    for (const auto& damage : region) {
+      stack.back().area[int(damage.waveform)] += area(damage.rect);
+    }
+  }
+
+  void pop() {
+    const auto frame = stack.back();
+    stack.pop_back();
+
+    const auto elapsed = clock::now() - frame.start;
+    const auto own = std::chrono::duration_cast<std::chrono::microseconds>(
+      elapsed - frame.childTime);
+
+    auto& stats = *frame.stats;
+    stats.count[frame.phase]++;
+    stats.time[frame.phase] += own;
+    for (int i = 0; i < num_waveforms; i++) {
+      stats.area[i] += std::max(0L, frame.area[i] - frame.childArea[i]);
+    }
+
+    if (frame.phase == Draw && own > stats.maxDraw) {
+      stats.maxDraw = own;
+      stats.maxDrawID = frame.id;
+    }
+
+    if (!stack.empty()) {
+      auto& parent = stack.back();
+      parent.childTime += elapsed;
+      for (int i = 0; i < num_waveforms; i++) {
+        parent.childArea[i] += frame.area[i];
+      }
+    }
+  }
+
+  /// Adds the weight of each update to the heatmap pixels it covers.
+  void addHeat(const UpdateRegion& region, int sign) {
+    for (const auto& damage : region) {
+      int weight = 1;
+      if (damage.waveform == fb::Waveform::GC16Fast) {
+        weight = 2;
+      } else if (damage.waveform == fb::Waveform::GC16) {
+        weight = 4;
+      }
+
+      const auto heatRect = Rect{ damage.rect.topLeft / heatmap_scale,
+                                  damage.rect.bottomRight / heatmap_scale } &
+                            Rect{ { 0, 0 }, heatSize.toPoint() };
+      for (int y = heatRect.topLeft.y; y <= heatRect.bottomRight.y; y++) {
+        for (int x = heatRect.topLeft.x; x <= heatRect.bottomRight.x; x++) {
+          heat[y * heatSize.width + x] += sign * weight;
+        }
+      }
+    }
+  }
+
+  inline static Profiler* current = nullptr;
+
+  std::unordered_map<std::type_index, TypeStats> types;
+  std::vector<Frame> stack;
+
+  int frames = 0;
+  std::array<int, num_waveforms> updates{};
+  std::array<long, num_waveforms> updateArea{};
+
+  int heatmapFrames;
+  std::vector<UpdateRegion> recent;
+  Size heatSize;
+  std::vector<int> heat;
+
+  Rect overlayRect;
+  std::optional<MemoryCanvas> saved;
+};
+
+} // namespace rmlib
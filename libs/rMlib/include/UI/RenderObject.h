@@ -3,9 +3,16 @@
 #include <Input.h>
 
 #include <UI/BuildContext.h>
+#include <UI/PaintContext.h>
+#include <UI/Profiler.h>
+#include <UI/RenderObjectPool.h>
 #include <UI/TypeID.h>
 #include <UI/Util.h>
 
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
 namespace rmlib {
 
 class AppContext;
@@ -27,20 +34,33 @@ class RenderObject {
 
 public:
   RenderObject(typeID::type_id_t typeID) : mTypeID(typeID), mID(roCount++) {
-#ifndef NDEBUG
+#ifdef RMLIB_TRACE_RENDER_OBJECTS
     std::cout << "alloc RO: " << mID << "\n";
 #endif
   }
 
   virtual ~RenderObject() {
-#ifndef NDEBUG
+#ifdef RMLIB_TRACE_RENDER_OBJECTS
     std::cout << "free RO: " << mID << "\n";
 #endif
     roCount--;
   }
 
+  /// Render objects are allocated from a pool, see `RenderObjectPool`. The
+  /// destructor is virtual, so the size is the one of the derived type.
+  static void* operator new(std::size_t size) {
+    return RenderObjectPool::get().allocate(size);
+  }
+
+  static void operator delete(void* ptr, std::size_t size) {
+    RenderObjectPool::get().deallocate(ptr, size);
+  }
+
+  /// Lays out the render object, the result is cached for the constraints.
   Size layout(const Constraints& constraints) {
-    if (needsLayout()) {
+    if (needsOwnLayout() || !lastConstraints.has_value() ||
+        *lastConstraints != constraints) {
+      auto scope = Profiler::Scope(Profiler::Layout, *this, mID);
       const auto result = doLayout(constraints);
       assert(result.width != Constraints::unbound &&
              result.height != Constraints::unbound);
@@ -48,27 +68,52 @@ public:
 
       mNeedsLayout = false;
 
+      lastConstraints = constraints;
       lastSize = result;
       return result;
     }
+
+    if (needsLayout()) {
+      // Only relayout boundaries below need layout, which can't change the
+      // size of this.
+      layoutChildren();
+    }
     return lastSize;
   }
 
   virtual UpdateRegion cleanup(rmlib::Canvas& canvas) {
-    if (isFullDraw()) {
-      canvas.set(this->rect, rmlib::white);
-      return UpdateRegion{ this->rect, rmlib::fb::Waveform::DU };
+    if (!isFullDraw()) {
+      return {};
+    }
+
+    // Render objects can be partly outside of the canvas.
+    const auto rect = this->rect & canvas.rect();
+    if (rect.width() <= 0 || rect.height() <= 0) {
+      return {};
     }
-    return {};
+    canvas.set(rect, rmlib::white);
+    return UpdateRegion{ rect, rmlib::fb::Waveform::DU };
   }
 
-  UpdateRegion draw(rmlib::Rect rect, rmlib::Canvas& canvas) {
+  /// Draws the render object in \p rect, it can't change anything outside.
+  UpdateRegion draw(rmlib::Rect rect, const PaintContext& ctx) {
     auto result = UpdateRegion{};
 
     // TODO: do we need to distinguish when cleanup is used?
     if (needsDraw()) {
       this->rect = rect;
-      result |= doDraw(rect, canvas);
+
+      // Nothing to change. The ancestor that makes it visible again, by
+      // moving or resizing it, redraws it.
+      if (!ctx.isVisible(rect)) {
+        markSubtreeDrawn();
+        return result;
+      }
+
+      auto scope = Profiler::Scope(Profiler::Draw, *this, mID);
+      const auto region = doDraw(rect, ctx.clipped(rect));
+      scope.setDamage(region);
+      result |= region;
 
       mNeedsDraw = No;
     }
@@ -98,19 +143,50 @@ public:
     return needsDrawCache.getOrSetTo([this] { return getNeedsDraw(); });
   }
 
+  /// True if anything in the subtree needs layout.
   bool needsLayout() {
     return needsLayoutCache.getOrSetTo([this] { return getNeedsLayout(); });
   }
 
+  /// True if `doLayout` needs to run, so not when only relayout boundaries in
+  /// the subtree need layout.
+  bool needsOwnLayout() {
+    return needsOwnLayoutCache.getOrSetTo(
+      [this] { return getNeedsOwnLayout(); });
+  }
+
+  /// Laid out with tight constraints, so a relayout can't change the size
+  /// and the parent doesn't need to relayout.
+  bool isRelayoutBoundary() const {
+    return lastConstraints.has_value() &&
+           lastConstraints->min == lastConstraints->max;
+  }
+
   const rmlib::Rect& getRect() const { return rect; }
 
   const Size& getSize() const { return lastSize; }
 
+  /// Marks only this render object, children are laid out again if their
+  /// constraints change.
   virtual void markNeedsLayout() { mNeedsLayout = true; }
+
+  /// Marks the whole subtree, to lay it out even if the constraints are the
+  /// same.
+  virtual void markSubtreeNeedsLayout() { markNeedsLayout(); }
+
   virtual void markNeedsDraw(bool full = true) {
     mNeedsDraw = full ? Full : (mNeedsDraw == No ? Partial : mNeedsDraw);
   }
 
+  /// Clears the draw marks of the whole subtree, used when it's clipped away
+  /// completely.
+  virtual void markSubtreeDrawn() { mNeedsDraw = No; }
+
+  /// Moves the subtree without drawing it, used when its pixels are copied
+  /// to a new position instead. Render objects that store other positions
+  /// should move them too.
+  virtual void moveBy(rmlib::Point delta) { rect += delta; }
+
   void markNeedsRebuild() {
     assert(!mInRebuild && "Don't mark rebuild from within rebuild()");
     mNeedsRebuild = true;
@@ -118,6 +194,7 @@ public:
 
   virtual void reset() {
     needsLayoutCache.reset();
+    needsOwnLayoutCache.reset();
     needsDrawCache.reset();
   }
 
@@ -125,12 +202,26 @@ public:
 
 protected:
   virtual Size doLayout(const Constraints& Constraints) = 0;
-  virtual UpdateRegion doDraw(rmlib::Rect rect, rmlib::Canvas& canvas) = 0;
+  virtual UpdateRegion doDraw(rmlib::Rect rect, const PaintContext& ctx) = 0;
   virtual void doRebuild(AppContext& context,
                          const BuildContext& buildContext) {}
 
   virtual bool getNeedsDraw() const { return mNeedsDraw != No; }
   virtual bool getNeedsLayout() const { return mNeedsLayout; }
+  virtual bool getNeedsOwnLayout() const { return mNeedsLayout; }
+
+  /// Lays out the children that need it with their last constraints.
+  virtual void layoutChildren() {}
+
+  static void relayout(RenderObject& child) {
+    if (child.needsLayout() && child.lastConstraints.has_value()) {
+      child.layout(*child.lastConstraints);
+    }
+  }
+
+  static bool childNeedsOwnLayout(RenderObject& child) {
+    return !child.isRelayoutBoundary() && child.needsOwnLayout();
+  }
 
   bool isPartialDraw() const { return mNeedsDraw == Partial; }
   bool isFullDraw() const { return mNeedsDraw == Full; }
@@ -143,9 +234,11 @@ private:
   rmlib::Rect rect;
 
   Size lastSize = { 0, 0 };
+  std::optional<Constraints> lastConstraints;
 
   // TODO: are both needed?
   CachedBool needsLayoutCache;
+  CachedBool needsOwnLayoutCache;
   bool mNeedsLayout = true;
 
   CachedBool needsDrawCache;
@@ -204,10 +297,10 @@ public:
     return child->cleanup(canvas);
   }
 
-  void markNeedsLayout() override {
+  void markSubtreeNeedsLayout() override {
     RenderObject::markNeedsLayout();
     if (child) {
-      child->markNeedsLayout();
+      child->markSubtreeNeedsLayout();
     }
   }
 
@@ -218,6 +311,20 @@ public:
     }
   }
 
+  void markSubtreeDrawn() override {
+    RenderObject::markSubtreeDrawn();
+    if (child) {
+      child->markSubtreeDrawn();
+    }
+  }
+
+  void moveBy(rmlib::Point delta) override {
+    RenderObject::moveBy(delta);
+    if (child) {
+      child->moveBy(delta);
+    }
+  }
+
   void rebuild(AppContext& context, const BuildContext* parent) final {
     RenderObject::rebuild(context, parent);
 #ifndef NDEBUG
@@ -239,8 +346,8 @@ protected:
     return child->layout(constraints);
   }
 
-  UpdateRegion doDraw(rmlib::Rect rect, rmlib::Canvas& canvas) override {
-    return child->draw(rect, canvas);
+  UpdateRegion doDraw(rmlib::Rect rect, const PaintContext& ctx) override {
+    return child->draw(rect, ctx);
   }
 
   bool getNeedsDraw() const override {
@@ -251,6 +358,12 @@ protected:
     return RenderObject::getNeedsLayout() || child->needsLayout();
   }
 
+  bool getNeedsOwnLayout() const override {
+    return RenderObject::getNeedsOwnLayout() || childNeedsOwnLayout(*child);
+  }
+
+  void layoutChildren() override { relayout(*child); }
+
   const Widget* widget;
   std::unique_ptr<RenderObject> child;
 };
@@ -270,6 +383,30 @@ getChildren(const std::vector<Widget>& widgets) {
   return children;
 }
 
+/// Gives a widget a key, so its render object is reused when it moves within
+/// the children of a multi child widget, like `Wrap`.
+template<typename Child>
+class Keyed {
+public:
+  Keyed(std::string key, Child child)
+    : key(std::move(key)), child(std::move(child)) {}
+
+  std::unique_ptr<RenderObject> createRenderObject() const {
+    return child.createRenderObject();
+  }
+
+  void update(RenderObject& ro) const { child.update(ro); }
+
+  std::string key;
+  Child child;
+};
+
+template<typename T>
+struct is_keyed : std::false_type {};
+
+template<typename Child>
+struct is_keyed<Keyed<Child>> : std::true_type {};
+
 template<typename Widget>
 class MultiChildRenderObject : public RenderObject {
 public:
@@ -296,10 +433,10 @@ public:
     return result;
   }
 
-  void markNeedsLayout() override {
+  void markSubtreeNeedsLayout() override {
     RenderObject::markNeedsLayout();
     for (auto& child : children) {
-      child->markNeedsLayout();
+      child->markSubtreeNeedsLayout();
     }
   }
 
@@ -310,6 +447,23 @@ public:
     }
   }
 
+  void markSubtreeDrawn() override {
+    RenderObject::markSubtreeDrawn();
+    for (auto& child : children) {
+      child->markSubtreeDrawn();
+    }
+  }
+
+  void moveBy(rmlib::Point delta) override {
+    RenderObject::moveBy(delta);
+    for (auto& child : children) {
+      child->moveBy(delta);
+    }
+    for (auto& removed : removedRects) {
+      removed += delta;
+    }
+  }
+
   void rebuild(AppContext& context, const BuildContext* parent) final {
     RenderObject::rebuild(context, parent);
 
@@ -333,14 +487,25 @@ public:
   }
 
 protected:
-  // template<typename Widget>
-  void updateChildren(const Widget& widget, const Widget& newWidget) {
+  /// Updates the children to the children of the new widget. Keyed children
+  /// keep their render object, other children are matched by index.
+  /// Returns true if children were added, removed or reordered.
+  bool updateChildren(const Widget& widget, const Widget& newWidget) {
+    using ChildWidget = typename decltype(newWidget.children)::value_type;
+
+    if constexpr (is_keyed<ChildWidget>::value) {
+      return updateKeyedChildren(widget, newWidget);
+    }
 
     auto updateEnd = children.size();
+    const bool changed = newWidget.children.size() != children.size();
 
-    if (newWidget.children.size() != children.size()) {
+    if (changed) {
       // TODO: move the ROs out of tree and reuse?
       if (newWidget.children.size() < children.size()) {
+        for (auto i = newWidget.children.size(); i < children.size(); i++) {
+          removedRects.push_back(children[i]->getRect());
+        }
         children.resize(newWidget.children.size());
         updateEnd = newWidget.children.size();
       } else {
@@ -356,6 +521,8 @@ protected:
     for (size_t i = 0; i < updateEnd; i++) {
       newWidget.children[i].update(*children[i]);
     }
+
+    return changed;
   }
 
   bool getNeedsDraw() const override {
@@ -372,7 +539,61 @@ protected:
            });
   }
 
+  bool getNeedsOwnLayout() const override {
+    return RenderObject::getNeedsOwnLayout() ||
+           std::any_of(children.begin(), children.end(), [](const auto& child) {
+             return childNeedsOwnLayout(*child);
+           });
+  }
+
+  void layoutChildren() override {
+    for (const auto& child : children) {
+      relayout(*child);
+    }
+  }
+
   std::vector<std::unique_ptr<RenderObject>> children;
+
+  /// Where the children removed since the last draw were drawn. Collected by
+  /// `updateChildren`, the subclass clears it in `doDraw`.
+  std::vector<rmlib::Rect> removedRects;
+
+private:
+  bool updateKeyedChildren(const Widget& widget, const Widget& newWidget) {
+    assert(widget.children.size() == children.size());
+
+    // The old widget is still alive, so its keys can be referenced.
+    std::unordered_map<std::string_view, std::size_t> oldIndices;
+    for (std::size_t i = 0; i < widget.children.size(); i++) {
+      oldIndices.emplace(widget.children[i].key, i);
+    }
+
+    bool changed = newWidget.children.size() != children.size();
+    std::vector<std::unique_ptr<RenderObject>> newChildren;
+    newChildren.reserve(newWidget.children.size());
+
+    for (const auto& child : newWidget.children) {
+      const auto it = oldIndices.find(child.key);
+      if (it == oldIndices.end() || children[it->second] == nullptr) {
+        newChildren.emplace_back(child.createRenderObject());
+        changed = true;
+        continue;
+      }
+
+      changed |= it->second != newChildren.size();
+      auto& ro = newChildren.emplace_back(std::move(children[it->second]));
+      child.update(*ro);
+    }
+
+    for (const auto& child : children) {
+      if (child != nullptr) {
+        removedRects.push_back(child->getRect());
+      }
+    }
+
+    children = std::move(newChildren);
+    return changed;
+  }
 };
 
 template<typename RO>
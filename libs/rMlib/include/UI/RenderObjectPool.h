@@ -0,0 +1,107 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <vector>
+
+namespace rmlib {
+
+/// Allocator for render objects. Memory is taken from large chunks, so render
+/// objects created together, like the children of a widget, end up next to
+/// each other. Freed blocks are kept in a list per size class and reused by
+/// the next render object of that size.
+///
+/// Render objects are only created on the UI thread, so this isn't locked.
+class RenderObjectPool {
+public:
+  static constexpr std::size_t block_align = alignof(std::max_align_t);
+  static constexpr std::size_t num_classes = 32;
+  static constexpr std::size_t max_block_size = num_classes * block_align;
+  static constexpr std::size_t chunk_size = 64 * 1024;
+
+  struct Stats {
+    std::size_t chunks = 0;
+    /// Render objects currently allocated from the pool.
+    std::size_t live = 0;
+    /// Allocations that took a freed block.
+    std::size_t reused = 0;
+    /// Render objects currently too large for the pool.
+    std::size_t large = 0;
+  };
+
+  static RenderObjectPool& get() {
+    static RenderObjectPool pool;
+    return pool;
+  }
+
+  void* allocate(std::size_t size) {
+    if (size > max_block_size) {
+      stats.large++;
+      return ::operator new(size);
+    }
+
+    stats.live++;
+    auto& head = freeLists[sizeClass(size)];
+    if (head != nullptr) {
+      stats.reused++;
+      auto* block = head;
+      head = block->next;
+      return block;
+    }
+
+    const auto blockSize = roundUp(size);
+    if (chunks.empty() || used + blockSize > chunk_size) {
+      // The rest of the old chunk is lost, it's at most one large block.
+      chunks.emplace_back(new std::byte[chunk_size]);
+      stats.chunks++;
+      used = 0;
+    }
+
+    auto* result = chunks.back().get() + used;
+    used += blockSize;
+    return result;
+  }
+
+  void deallocate(void* ptr, std::size_t size) {
+    if (size > max_block_size) {
+      stats.large--;
+      ::operator delete(ptr);
+      return;
+    }
+
+    stats.live--;
+    auto* block = static_cast<FreeBlock*>(ptr);
+    auto& head = freeLists[sizeClass(size)];
+    block->next = head;
+    head = block;
+  }
+
+  const Stats& getStats() const { return stats; }
+
+private:
+  struct FreeBlock {
+    FreeBlock* next;
+  };
+
+  static std::size_t roundUp(std::size_t size) {
+    return (size + block_align - 1) / block_align * block_align;
+  }
+
+  static std::size_t sizeClass(std::size_t size) {
+    return roundUp(size) / block_align - 1;
+  }
+
+  RenderObjectPool() { freeLists.fill(nullptr); }
+
+  // Chunks must be aligned for any render object, which new[] guarantees.
+  static_assert(__STDCPP_DEFAULT_NEW_ALIGNMENT__ >= block_align);
+
+  std::array<FreeBlock*, num_classes> freeLists;
+  std::vector<std::unique_ptr<std::byte[]>> chunks;
+  std::size_t used = 0;
+  Stats stats;
+};
+
+} // namespace rmlib
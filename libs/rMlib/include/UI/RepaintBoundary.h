@@ -0,0 +1,111 @@
+#pragma once
+
+#include <UI/RenderObject.h>
+#include <UI/Widget.h>
+
+#include <Canvas.h>
+
+#include <optional>
+
+namespace rmlib {
+
+template<typename Child>
+class RepaintBoundary;
+
+template<typename Child>
+class RepaintBoundaryRenderObject
+  : public SingleChildRenderObject<RepaintBoundary<Child>> {
+public:
+  using SingleChildRenderObject<RepaintBoundary<Child>>::SingleChildRenderObject;
+
+  void update(const RepaintBoundary<Child>& newWidget) {
+    this->widget = &newWidget;
+    this->widget->child.update(*this->child);
+  }
+
+  /// Redraws from ancestors stop here, the cached pixels are copied instead.
+  /// The child still redraws when it marks itself.
+  void markNeedsDraw(bool full = true) override {
+    RenderObject::markNeedsDraw(full);
+  }
+
+  /// The child may change while it's hidden, so the cache can't be used once
+  /// it's visible again.
+  void markSubtreeDrawn() override {
+    SingleChildRenderObject<RepaintBoundary<Child>>::markSubtreeDrawn();
+    cachedVisible.reset();
+  }
+
+protected:
+  UpdateRegion doDraw(rmlib::Rect rect, const PaintContext& ctx) override {
+    // The child keeps its pixels when moved, only its position changes.
+    const auto moved = cachedRect.has_value() &&
+                       cachedRect->size() == rect.size() &&
+                       cachedRect->topLeft != rect.topLeft;
+    if (moved) {
+      this->child->moveBy(rect.topLeft - cachedRect->topLeft);
+    }
+
+    auto result = UpdateRegion{};
+    auto& canvas = ctx.canvas();
+    const auto visible = ctx.clip();
+
+    const auto cacheFits = cache.has_value() &&
+                           cache->canvas.width() == rect.width() &&
+                           cache->canvas.height() == rect.height() &&
+                           cache->canvas.components() == canvas.components();
+
+    // Only the visible part of the child is copied to the cache.
+    const auto cacheValid = cacheFits && cachedVisible.has_value() &&
+                            cachedVisible->contains(visible - rect.topLeft);
+    if (!cacheValid) {
+      if (!cacheFits) {
+        cache.emplace(rect.width(), rect.height(), canvas.components());
+      }
+
+      // Reset the cached needs draw state, it may have been read already.
+      this->child->markNeedsDraw(true);
+      this->child->reset();
+    } else if (this->isFullDraw() || moved) {
+      ctx.drawImage(cache->canvas, rect.topLeft);
+      result = UpdateRegion{ rect };
+    }
+
+    const auto childRegion = this->child->draw(rect, ctx);
+    if (!childRegion.empty()) {
+      copy(cache->canvas,
+           visible.topLeft - rect.topLeft,
+           canvas,
+           visible + ctx.offset());
+      result |= childRegion;
+    }
+
+    cachedRect = rect;
+    cachedVisible = visible - rect.topLeft;
+    return result;
+  }
+
+private:
+  std::optional<MemoryCanvas> cache;
+  std::optional<rmlib::Rect> cachedRect;
+
+  /// The part of the cache that is up to date, relative to `cachedRect`.
+  std::optional<rmlib::Rect> cachedVisible;
+};
+
+/// Keeps a copy of the pixels of its child. When an ancestor redraws, or only
+/// the position changes, the copy is used instead of drawing the child again.
+/// Useful for large subtrees that rarely change.
+template<typename Child>
+class RepaintBoundary : public Widget<RepaintBoundaryRenderObject<Child>> {
+public:
+  RepaintBoundary(Child child) : child(std::move(child)) {}
+
+  std::unique_ptr<RenderObject> createRenderObject() const {
+    return std::make_unique<RepaintBoundaryRenderObject<Child>>(*this);
+  }
+
+  Child child;
+};
+
+} // namespace rmlib
@@ -55,12 +55,15 @@ protected:
     return result;
   }
 
-  UpdateRegion doDraw(Rect rect, Canvas& canvas) override {
+  UpdateRegion doDraw(Rect rect, const PaintContext& ctx) override {
     UpdateRegion result;
 
+    // Removing children marks the whole stack, so cleanup cleared them.
+    this->removedRects.clear();
+
     for (const auto& child : this->children) {
       const auto subRect = rect.align(child->getSize(), 0, 0);
-      result |= child->draw(subRect, canvas);
+      result |= child->draw(subRect, ctx);
     }
 
     return result;
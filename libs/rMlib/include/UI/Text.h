@@ -63,7 +63,7 @@ protected:
     return result;
   }
 
-  UpdateRegion doDraw(rmlib::Rect rect, rmlib::Canvas& canvas) override {
+  UpdateRegion doDraw(rmlib::Rect rect, const PaintContext& ctx) override {
     const auto textSize =
       rmlib::Canvas::getTextSize(widget->text, widget->fontSize);
     const auto x = std::max(0, (rect.width() - textSize.x) / 2);
@@ -71,16 +71,12 @@ protected:
 
     const auto point = rect.topLeft + rmlib::Point{ x, y };
 
-    // TODO: intersect with rect, fix size - 1:
+    // TODO: fix size - 1:
     const auto drawRect = rmlib::Rect{ point, point + textSize } & rect;
 
-    canvas.set(drawRect, rmlib::white);
-    canvas.drawText(widget->text,
-                    point,
-                    widget->fontSize,
-                    black,
-                    white,
-                    /* clip */ rect);
+    // The context clips to the rect.
+    ctx.fill(drawRect, rmlib::white);
+    ctx.drawText(widget->text, point, widget->fontSize, black, white);
     return UpdateRegion{ drawRect };
   }
 
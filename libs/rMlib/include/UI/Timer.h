@@ -1,113 +1,287 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <cassert>
 #include <chrono>
-#include <queue>
+#include <cstdint>
+#include <optional>
+#include <vector>
 
 #include <UI/Util.h>
 
 namespace rmlib {
-class Timer;
+class TimerWheel;
 
+/// Owns a timer of a `TimerWheel`. The timer is disabled when the handle is
+/// destroyed or another timer is assigned to it.
 struct TimerHandle {
-  TimerHandle(std::shared_ptr<Timer> timer) : timer(std::move(timer)) {}
-  ~TimerHandle();
-
   TimerHandle() = default;
-  TimerHandle(TimerHandle&&) = default;
-  TimerHandle& operator=(TimerHandle&&) = default;
+  ~TimerHandle() { disable(); }
+
+  TimerHandle(TimerHandle&& other) noexcept
+    : wheel(other.wheel), index(other.index), generation(other.generation) {
+    other.wheel = nullptr;
+  }
+
+  TimerHandle& operator=(TimerHandle&& other) noexcept {
+    if (this != &other) {
+      disable();
+      wheel = other.wheel;
+      index = other.index;
+      generation = other.generation;
+      other.wheel = nullptr;
+    }
+    return *this;
+  }
 
   TimerHandle(const TimerHandle&) = delete;
   TimerHandle& operator=(const TimerHandle&) = delete;
 
+  /// Removes the timer from the wheel, its callback won't be called anymore.
   void disable();
 
 private:
-  std::shared_ptr<Timer> timer;
+  friend class TimerWheel;
+
+  TimerHandle(TimerWheel* wheel, uint32_t index, uint32_t generation)
+    : wheel(wheel), index(index), generation(generation) {}
+
+  TimerWheel* wheel = nullptr;
+  uint32_t index = 0;
+  uint32_t generation = 0;
 };
 
-class Timer {
+/// Hashed timer wheel. Timers are kept in intrusive lists, one per tick of the
+/// wheel, so adding and disabling them is O(1). Timers further away than one
+/// turn share the slots and are skipped until their tick comes around.
+class TimerWheel {
+public:
   using clock = std::chrono::steady_clock;
 
-public:
-  static std::pair<std::shared_ptr<Timer>, TimerHandle> makeTimer(
+  /// The length of a tick. Timers are called on the first tick at or after
+  /// their deadline.
+  using resolution = std::chrono::milliseconds;
+  static constexpr int64_t num_slots = 1024;
+
+  TimerWheel() : currentTick(floorTick(clock::now())) { heads.fill(none); }
+
+  TimerWheel(const TimerWheel&) = delete;
+  TimerWheel& operator=(const TimerWheel&) = delete;
+
+  TimerHandle add(
     std::chrono::microseconds duration,
     Callback callback,
     std::optional<std::chrono::microseconds> repeat = std::nullopt) {
+    uint32_t index = freeHead;
+    if (index == none) {
+      index = uint32_t(nodes.size());
+      nodes.emplace_back();
+    } else {
+      freeHead = nodes[index].next;
+    }
 
-    auto timer =
-      std::shared_ptr<Timer>(new Timer(duration, std::move(callback), repeat));
-    auto handle = TimerHandle(timer);
+    auto& node = nodes[index];
+    node.callback = std::move(callback);
+    node.repeat = repeat;
+    insert(index, clock::now() + duration);
+    active++;
 
-    return { std::move(timer), std::move(handle) };
+    return TimerHandle(this, index, node.generation);
   }
 
-  bool check() const {
-    if (!enabled) {
-      return true;
+  /// Calls the callbacks of all timers that are due at `now`.
+  void advance(clock::time_point now = clock::now()) {
+    const auto nowTick = floorTick(now);
+    if (nowTick <= currentTick) {
+      return;
     }
 
-    if (clock::now() >= triggerTime) {
+    // Unlink the due timers first, the callbacks can add or disable timers.
+    assert(expired.empty() && "Timers advanced from a timer callback");
+    const auto ticks = std::min(nowTick - currentTick, num_slots);
+    for (int64_t tick = currentTick + 1; tick <= currentTick + ticks; tick++) {
+      for (auto index = heads[slotOf(tick)]; index != none;) {
+        const auto next = nodes[index].next;
+        if (nodes[index].expiry <= nowTick) {
+          unlink(index);
+          expired.push_back({ index, nodes[index].generation });
+        }
+        index = next;
+      }
+    }
+    currentTick = nowTick;
+    nextExpiry = std::nullopt;
+
+    for (const auto [index, generation] : expired) {
+      // Disabled by an earlier callback.
+      if (nodes[index].generation != generation) {
+        continue;
+      }
+
+      // Move the callback out, it may disable its own timer.
+      auto callback = std::move(nodes[index].callback);
       callback();
-      return true;
+
+      auto& node = nodes[index];
+      if (node.generation != generation) {
+        continue;
+      }
+
+      if (node.repeat.has_value()) {
+        node.callback = std::move(callback);
+        insert(index, now + *node.repeat);
+      } else {
+        release(index);
+      }
+    }
+    expired.clear();
+  }
+
+  /// The deadline of the next timer, nullopt if there are no timers.
+  std::optional<clock::time_point> getNextDeadline() {
+    if (!nextExpiry.has_value()) {
+      nextExpiry = findNextExpiry();
     }
 
-    return false;
+    if (!nextExpiry.has_value()) {
+      return std::nullopt;
+    }
+    return clock::time_point(resolution(*nextExpiry));
+  }
+
+  bool empty() const { return active == 0; }
+
+private:
+  friend struct TimerHandle;
+
+  static constexpr uint32_t none = UINT32_MAX;
+
+  struct Node {
+    Callback callback;
+    std::optional<std::chrono::microseconds> repeat;
+    int64_t expiry = 0;
+    uint32_t prev = none;
+    uint32_t next = none;
+    uint32_t generation = 0;
+    bool linked = false;
+  };
+
+  static int64_t floorTick(clock::time_point time) {
+    return std::chrono::floor<resolution>(time.time_since_epoch()).count();
   }
 
-  std::chrono::microseconds getDuration() const {
-    return std::chrono::duration_cast<std::chrono::microseconds>(triggerTime -
-                                                                 clock::now());
+  static int64_t ceilTick(clock::time_point time) {
+    return std::chrono::ceil<resolution>(time.time_since_epoch()).count();
   }
 
-  bool repeats() const { return repeat.has_value(); }
+  static std::size_t slotOf(int64_t tick) { return tick % num_slots; }
+
+  void insert(uint32_t index, clock::time_point deadline) {
+    auto& node = nodes[index];
+
+    // The current tick is already done, use the next one.
+    node.expiry = std::max(ceilTick(deadline), currentTick + 1);
+
+    auto& head = heads[slotOf(node.expiry)];
+    node.prev = none;
+    node.next = head;
+    if (head != none) {
+      nodes[head].prev = index;
+    }
+    head = index;
+    node.linked = true;
 
-  void reset() {
-    assert(repeats());
-    triggerTime = clock::now() + *repeat;
+    if (nextExpiry.has_value() && node.expiry < *nextExpiry) {
+      nextExpiry = node.expiry;
+    }
   }
 
-  void disable() {
-    enabled = false;
-    repeat = std::nullopt;
+  void unlink(uint32_t index) {
+    auto& node = nodes[index];
+    if (node.prev != none) {
+      nodes[node.prev].next = node.next;
+    } else {
+      heads[slotOf(node.expiry)] = node.next;
+    }
+    if (node.next != none) {
+      nodes[node.next].prev = node.prev;
+    }
+    node.linked = false;
+
+    if (nextExpiry.has_value() && node.expiry == *nextExpiry) {
+      nextExpiry = std::nullopt;
+    }
   }
 
-private:
-  Timer(std::chrono::microseconds duration,
-        Callback callback,
-        std::optional<std::chrono::microseconds> repeat = std::nullopt)
-    : repeat(repeat)
-    , triggerTime(clock::now() + duration)
-    , callback(std::move(callback)) {}
-
-  friend struct TimerCmp;
-
-  std::optional<std::chrono::microseconds> repeat;
-  clock::time_point triggerTime;
-  Callback callback;
-  bool enabled = true;
-};
+  void release(uint32_t index) {
+    auto& node = nodes[index];
+    node.callback = nullptr;
+    node.generation++;
+    node.next = freeHead;
+    freeHead = index;
+    active--;
+  }
+
+  void disable(uint32_t index, uint32_t generation) {
+    if (index >= nodes.size() || nodes[index].generation != generation) {
+      return;
+    }
 
-struct TimerCmp {
-  bool operator()(const std::shared_ptr<Timer>& lhs,
-                  const std::shared_ptr<Timer>& rhs) {
-    return lhs->triggerTime > rhs->triggerTime;
+    // Timers that are being called aren't linked.
+    if (nodes[index].linked) {
+      unlink(index);
+    }
+    release(index);
+  }
+
+  std::optional<int64_t> findNextExpiry() const {
+    if (active == 0) {
+      return std::nullopt;
+    }
+
+    // A timer in the slot of its own tick is the earliest one.
+    for (int64_t tick = currentTick + 1; tick <= currentTick + num_slots;
+         tick++) {
+      for (auto index = heads[slotOf(tick)]; index != none;
+           index = nodes[index].next) {
+        if (nodes[index].expiry == tick) {
+          return tick;
+        }
+      }
+    }
+
+    // All timers are more than one turn away.
+    std::optional<int64_t> result;
+    for (const auto& node : nodes) {
+      if (node.linked && (!result.has_value() || node.expiry < *result)) {
+        result = node.expiry;
+      }
+    }
+    return result;
   }
+
+  struct Expired {
+    uint32_t index;
+    uint32_t generation;
+  };
+
+  std::array<uint32_t, num_slots> heads;
+  std::vector<Node> nodes;
+  std::vector<Expired> expired;
+  uint32_t freeHead = none;
+  std::size_t active = 0;
+
+  int64_t currentTick;
+  std::optional<int64_t> nextExpiry;
 };
 
 inline void
 TimerHandle::disable() {
-  if (timer != nullptr) {
-    timer->disable();
-    timer = nullptr;
+  if (wheel != nullptr) {
+    wheel->disable(index, generation);
+    wheel = nullptr;
   }
 }
 
-inline TimerHandle::~TimerHandle() {
-  disable();
-}
-
-using TimerQueue = std::priority_queue<std::shared_ptr<Timer>,
-                                       std::vector<std::shared_ptr<Timer>>,
-                                       TimerCmp>;
-
 } // namespace rmlib
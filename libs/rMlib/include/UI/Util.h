@@ -2,7 +2,10 @@
 
 #include <FrameBuffer.h>
 #include <MathUtil.h>
+
+#include <array>
 #include <functional>
+#include <limits>
 
 namespace rmlib {
 
@@ -68,6 +71,14 @@ struct Constraints {
                         { maxHorizontal, maxVertical } };
   }
 
+  constexpr bool operator==(const Constraints& other) const {
+    return min == other.min && max == other.max;
+  }
+
+  constexpr bool operator!=(const Constraints& other) const {
+    return !(*this == other);
+  }
+
   constexpr Size expand(Size size, Insets insets) const {
     const auto newWidth = size.width + insets.horizontal();
     const auto newHeight = size.height + insets.vertical();
@@ -77,45 +88,155 @@ struct Constraints {
   }
 };
 
+/// A damaged rect with the waveform needed to update it.
+struct Damage {
+  Rect rect;
+  fb::Waveform waveform = fb::Waveform::GC16Fast;
+  fb::UpdateFlags flags = fb::UpdateFlags::None;
+};
+
+/// The damage of a frame, as a short list of rects that each get their own
+/// screen update. Rects are merged when a single update of their union is
+/// cheaper, so small changes in opposite corners don't refresh the whole
+/// screen with the slowest waveform of the two.
+///
+/// Overlapping rects with different waveforms are always merged, as the order
+/// of their updates would decide which waveform wins. So the rects can be
+/// submitted in any order.
 struct UpdateRegion {
-  constexpr UpdateRegion() : region(), waveform(fb::Waveform::DU) {}
+  /// More rects than this are merged, even if it costs more.
+  static constexpr int max_rects = 8;
 
-  constexpr UpdateRegion(Rect region)
-    : region(region), waveform(fb::Waveform::GC16Fast) {}
+  constexpr UpdateRegion() = default;
 
-  constexpr UpdateRegion(Rect region, fb::Waveform waveform)
-    : region(region), waveform(waveform) {}
+  constexpr UpdateRegion(Rect region)
+    : UpdateRegion(region, fb::Waveform::GC16Fast) {}
 
   constexpr UpdateRegion(Rect region,
                          fb::Waveform waveform,
-                         fb::UpdateFlags flags)
-    : region(region), waveform(waveform), flags(flags) {}
+                         fb::UpdateFlags flags = fb::UpdateFlags::None) {
+    if (!isEmpty(region)) {
+      rects[0] = Damage{ region, waveform, flags };
+      count = 1;
+    }
+  }
 
-  Rect region = { { 0, 0 }, { 0, 0 } };
-  fb::Waveform waveform = fb::Waveform::GC16Fast;
-  fb::UpdateFlags flags = fb::UpdateFlags::None;
+  bool empty() const { return count == 0; }
+  int size() const { return count; }
+
+  const Damage* begin() const { return rects.data(); }
+  const Damage* end() const { return rects.data() + count; }
 
-  constexpr UpdateRegion& operator|=(const UpdateRegion& other) {
-    if (other.waveform == fb::Waveform::GC16) {
-      waveform = other.waveform;
-    } else if (other.waveform == fb::Waveform::GC16Fast &&
-               waveform == fb::Waveform::DU) {
-      waveform = other.waveform;
+  /// The bounding box of all damage.
+  Rect bounds() const {
+    auto result = Rect{};
+    for (const auto& damage : *this) {
+      result = result.empty() ? damage.rect : result | damage.rect;
     }
+    return result;
+  }
 
-    if (region.empty()) {
-      region = other.region;
-    } else if (!other.region.empty()) {
-      region |= other.region;
+  void add(Damage damage) {
+    if (isEmpty(damage.rect)) {
+      return;
     }
 
-    flags = static_cast<fb::UpdateFlags>(flags | other.flags);
+    // Merge with existing rects until none is left to merge with. The
+    // merged rect is larger, so it can overlap or make merges cheaper with
+    // other rects too.
+    while (true) {
+      int index = 0;
+      while (index < count && !shouldMerge(rects[index], damage)) {
+        index++;
+      }
+
+      if (index == count) {
+        if (count < max_rects) {
+          break;
+        }
+        index = cheapestMerge(damage);
+      }
+
+      damage = merge(rects[index], damage);
+      rects[index] = rects[--count];
+    }
 
+    rects[count++] = damage;
+  }
+
+  UpdateRegion& operator|=(const UpdateRegion& other) {
+    for (const auto& damage : other) {
+      add(damage);
+    }
     return *this;
   }
+
+private:
+  static constexpr bool isEmpty(const Rect& rect) {
+    return rect.width() <= 0 || rect.height() <= 0;
+  }
+
+  /// Merges to the slowest waveform, which is needed for the whole rect.
+  static constexpr fb::Waveform mergeWaveform(fb::Waveform a,
+                                              fb::Waveform b) {
+    if (a == fb::Waveform::GC16 || b == fb::Waveform::GC16) {
+      return fb::Waveform::GC16;
+    }
+    if (a == fb::Waveform::GC16Fast || b == fb::Waveform::GC16Fast) {
+      return fb::Waveform::GC16Fast;
+    }
+    return fb::Waveform::DU;
+  }
+
+  static constexpr bool shouldMerge(const Damage& a, const Damage& b) {
+    if (a.waveform != b.waveform && !isEmpty(a.rect & b.rect)) {
+      return true;
+    }
+    return cost(merge(a, b)) <= cost(a) + cost(b);
+  }
+
+  /// The rect that adds the least cost when merged with \p damage.
+  int cheapestMerge(const Damage& damage) const {
+    int best = 0;
+    auto bestExtra = std::numeric_limits<long>::max();
+    for (int i = 0; i < count; i++) {
+      const auto extra =
+        cost(merge(rects[i], damage)) - cost(rects[i]) - cost(damage);
+      if (extra < bestExtra) {
+        bestExtra = extra;
+        best = i;
+      }
+    }
+    return best;
+  }
+
+  static constexpr Damage merge(const Damage& a, const Damage& b) {
+    return Damage{ a.rect | b.rect,
+                   mergeWaveform(a.waveform, b.waveform),
+                   static_cast<fb::UpdateFlags>(a.flags | b.flags) };
+  }
+
+  /// Rough cost of an update: a fixed overhead per update, plus the area
+  /// weighted by how long the waveform takes.
+  static constexpr long cost(const Damage& damage) {
+    constexpr long update_overhead = 128 * 128;
+
+    long weight = 1;
+    if (damage.waveform == fb::Waveform::GC16Fast) {
+      weight = 2;
+    } else if (damage.waveform == fb::Waveform::GC16) {
+      weight = 4;
+    }
+
+    const auto area = long(damage.rect.width()) * damage.rect.height();
+    return (update_overhead + area) * weight;
+  }
+
+  std::array<Damage, max_rects> rects{};
+  int count = 0;
 };
 
-constexpr UpdateRegion
+inline UpdateRegion
 operator|(UpdateRegion a, const UpdateRegion& b) {
   a |= b;
   return a;
@@ -16,14 +16,16 @@ public:
     , widget(&widget) {}
 
   void update(const Wrap<Child>& newWidget) {
-    bool changed = newWidget.axis != widget->axis ||
-                   newWidget.children.size() != this->children.size();
+    const bool axisChanged = newWidget.axis != widget->axis;
+    const bool childrenChanged = this->updateChildren(*widget, newWidget);
 
-    this->updateChildren(*widget, newWidget);
-
-    if (changed) {
+    if (axisChanged) {
       this->markNeedsLayout();
       this->markNeedsDraw();
+    } else if (childrenChanged) {
+      // Only relayout and redraw the children that moved, see `doDraw`.
+      RenderObject::markNeedsLayout();
+      RenderObject::markNeedsDraw(/* full */ false);
     }
 
     widget = &newWidget;
@@ -42,11 +44,7 @@ protected:
     Size result = { 0, 0 };
     Size rowSize = { 0, 0 };
     for (const auto& child : this->children) {
-      const auto oldSize = child->getSize();
       const auto size = child->layout(childConstraints);
-      if (oldSize != size) {
-        this->markNeedsDraw();
-      }
 
       if (isVertical()) {
         if (rowSize.height + size.height > constraints.max.height) {
@@ -97,13 +95,14 @@ protected:
     return result;
   }
 
-  UpdateRegion doDraw(Rect rect, Canvas& canvas) override {
+  UpdateRegion doDraw(Rect rect, const PaintContext& ctx) override {
     UpdateRegion result;
 
     const auto origin =
       ((rect.size() - totalSize) / 2).toPoint() + Point{ 1, 1 };
     auto offset = origin;
 
+    childRects.clear();
     int run = 0;
     for (const auto& child : this->children) {
       const auto size = child->getSize();
@@ -120,9 +119,8 @@ protected:
         }
       }
 
-      const auto subRect =
-        Rect{ rect.topLeft + offset, rect.topLeft + offset + size.toPoint() };
-      result |= child->draw(subRect, canvas);
+      childRects.push_back(
+        Rect{ rect.topLeft + offset, rect.topLeft + offset + size.toPoint() });
 
       if (isVertical()) {
         offset.y += size.height;
@@ -131,14 +129,46 @@ protected:
       }
     }
 
+    if (!this->isFullDraw()) {
+      // Clear where children were removed or moved away from, before any
+      // child is drawn at its new position.
+      for (const auto& removed : this->removedRects) {
+        result |= clear(removed, ctx);
+      }
+
+      for (std::size_t i = 0; i < this->children.size(); i++) {
+        auto& child = this->children[i];
+        if (child->getRect() != childRects[i]) {
+          result |= clear(child->getRect(), ctx);
+          child->markNeedsDraw();
+          child->reset();
+        }
+      }
+    }
+    this->removedRects.clear();
+
+    for (std::size_t i = 0; i < this->children.size(); i++) {
+      result |= this->children[i]->draw(childRects[i], ctx);
+    }
+
     return result;
   }
 
 private:
   bool isVertical() const { return widget->axis == Axis::Vertical; }
 
+  static UpdateRegion clear(Rect rect, const PaintContext& ctx) {
+    rect = rect & ctx.clip();
+    if (rect.width() <= 0 || rect.height() <= 0) {
+      return {};
+    }
+    ctx.fill(rect, white);
+    return UpdateRegion{ rect, fb::Waveform::DU };
+  }
+
   const Wrap<Child>* widget;
   std::vector<int> runSizes;
+  std::vector<Rect> childRects;
   Size totalSize;
 };
 
@@ -0,0 +1,88 @@
+#include <FrameBuffer.h>
+#include <Input.h>
+#include <Stroke.h>
+
+#include <csignal>
+#include <cstdlib>
+#include <iostream>
+#include <string_view>
+
+using namespace rmlib;
+using namespace rmlib::input;
+
+namespace {
+volatile std::sig_atomic_t stop = 0;
+
+void
+onSignal(int) {
+  stop = 1;
+}
+} // namespace
+
+int
+main(int argc, char* argv[]) {
+  bool useThread = false;
+  auto options = StrokeOptions{};
+
+  for (int i = 1; i < argc; i++) {
+    const auto arg = std::string_view(argv[i]);
+    if (arg == "--thread") {
+      useThread = true;
+    } else if (arg == "--no-predict") {
+      options.predictionTime = std::chrono::milliseconds(0);
+    } else {
+      std::cerr << "Usage: " << argv[0] << " [--thread] [--no-predict]\n";
+      return EXIT_FAILURE;
+    }
+  }
+
+  auto fb = fb::FrameBuffer::open();
+  if (fb.isError()) {
+    std::cerr << fb.getError().msg << std::endl;
+    return EXIT_FAILURE;
+  }
+  fb->clear();
+
+  InputManager input;
+  if (auto err = input.openAll(); err.isError()) {
+    std::cerr << err.getError().msg << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  if (useThread) {
+    if (auto err = input.startInputThread(); err.isError()) {
+      std::cerr << err.getError().msg << std::endl;
+    }
+  }
+
+  std::signal(SIGINT, onSignal);
+  std::signal(SIGTERM, onSignal);
+
+  StrokeRenderer renderer(*fb, options);
+  std::vector<Event> events;
+
+  while (stop == 0) {
+    events.clear();
+    if (auto err = input.waitForInput(events, std::nullopt); err.isError()) {
+      std::cerr << "Reading input error: " << err.getError().msg << "\n";
+      continue;
+    }
+
+    for (const auto& event : events) {
+      if (std::holds_alternative<PenEvent>(event)) {
+        renderer.handleEvent(std::get<PenEvent>(event));
+      }
+    }
+    renderer.flush();
+  }
+
+  const auto& latency = renderer.getLatency();
+  std::cout << "samples: " << latency.samples << "\n";
+  if (latency.samples != 0) {
+    std::cout << "latency min/mean/max: " << latency.min.count() << "/"
+              << latency.mean().count() << "/" << latency.max.count()
+              << " us\n";
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,273 @@
+#include <Input.h>
+#include <InputRecording.h>
+
+#include <linux/input.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+using namespace rmlib;
+using namespace rmlib::input;
+
+// Count all allocations, so we can check the decoding doesn't allocate.
+namespace {
+std::atomic<std::size_t> allocations = 0;
+} // namespace
+
+void*
+operator new(std::size_t size) {
+  allocations++;
+  if (void* ptr = std::malloc(size)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+void
+operator delete(void* ptr) noexcept {
+  std::free(ptr);
+}
+
+void
+operator delete(void* ptr, std::size_t) noexcept {
+  std::free(ptr);
+}
+
+namespace {
+
+input_event
+makeEvent(int type, int code, int value) {
+  auto ev = input_event{};
+  ev.type = type;
+  ev.code = code;
+  ev.value = value;
+  return ev;
+}
+
+/// A pen stroke across the screen, for when no recording is given.
+std::vector<input_event>
+makePenStream() {
+  std::vector<input_event> result;
+  result.push_back(makeEvent(EV_KEY, BTN_TOOL_PEN, 1));
+  result.push_back(makeEvent(EV_KEY, BTN_TOUCH, 1));
+  for (int i = 0; i < 1000; i++) {
+    result.push_back(makeEvent(EV_ABS, ABS_X, i * 10));
+    result.push_back(makeEvent(EV_ABS, ABS_Y, i * 5));
+    result.push_back(makeEvent(EV_ABS, ABS_PRESSURE, 1000 + i));
+    result.push_back(makeEvent(EV_ABS, ABS_DISTANCE, 0));
+    result.push_back(makeEvent(EV_SYN, SYN_REPORT, 0));
+  }
+  result.push_back(makeEvent(EV_KEY, BTN_TOUCH, 0));
+  result.push_back(makeEvent(EV_KEY, BTN_TOOL_PEN, 0));
+  result.push_back(makeEvent(EV_SYN, SYN_REPORT, 0));
+  return result;
+}
+
+/// Reads raw events, as recorded by `cat /dev/input/eventX > file`.
+std::vector<input_event>
+readStream(const char* path) {
+  std::ifstream file(path, std::ios::binary);
+  std::vector<input_event> result;
+
+  auto ev = input_event{};
+  while (file.read(reinterpret_cast<char*>(&ev), sizeof(ev))) {
+    result.push_back(ev);
+  }
+  return result;
+}
+
+std::optional<InputType>
+parseType(std::string_view type) {
+  if (type == "touch") {
+    return InputType::Touch;
+  }
+  if (type == "pen") {
+    return InputType::Pen;
+  }
+  if (type == "key") {
+    return InputType::Key;
+  }
+  return std::nullopt;
+}
+
+const char*
+typeName(InputType type) {
+  switch (type) {
+    case InputType::Touch:
+      return "touch";
+    case InputType::Pen:
+      return "pen";
+    case InputType::Key:
+      return "key";
+  }
+  return "unknown";
+}
+
+constexpr auto iterations = 1000;
+
+/// Less than the pipe capacity, so a chunk can be written at once.
+constexpr std::size_t chunk_size = 1024;
+
+struct Result {
+  std::size_t decodedEvents = 0;
+  std::chrono::nanoseconds time{ 0 };
+  std::size_t allocs = 0;
+};
+
+/// Decodes the stream from memory, without any syscalls.
+Result
+benchDecode(const InputReplayer::Stream& stream) {
+  auto device = makeVirtualDevice(stream.type, stream.transform);
+  std::vector<Event> events;
+
+  // Warm up, so the buffer has its final capacity.
+  device->decodeEvents(stream.events.data(), stream.events.size(), events);
+
+  auto result = Result{};
+  result.decodedEvents = events.size();
+
+  const auto startAllocs = allocations.load();
+  const auto start = std::chrono::steady_clock::now();
+
+  for (int i = 0; i < iterations; i++) {
+    events.clear();
+    device->decodeEvents(stream.events.data(), stream.events.size(), events);
+  }
+
+  result.time = std::chrono::steady_clock::now() - start;
+  result.allocs = allocations.load() - startAllocs;
+  return result;
+}
+
+/// Feeds the stream through a pipe to `readEvents`, like a device node. Only
+/// the reads are timed.
+std::optional<Result>
+benchRead(const InputReplayer::Stream& stream) {
+  int fds[2];
+  if (pipe2(fds, O_NONBLOCK | O_CLOEXEC) != 0) {
+    perror("Error creating pipe");
+    return std::nullopt;
+  }
+
+  auto device = makeVirtualDevice(stream.type, stream.transform, fds[0]);
+  std::vector<Event> events;
+  auto result = Result{};
+
+  for (int i = 0; i <= iterations; i++) {
+    // The first iteration warms up the buffer.
+    const auto measure = i != 0;
+    events.clear();
+
+    for (std::size_t offset = 0; offset < stream.events.size();
+         offset += chunk_size) {
+      const auto count = std::min(chunk_size, stream.events.size() - offset);
+      const auto size = count * sizeof(input_event);
+      if (write(fds[1], stream.events.data() + offset, size) !=
+          ssize_t(size)) {
+        perror("Error writing events");
+        close(fds[1]);
+        return std::nullopt;
+      }
+
+      const auto startAllocs = allocations.load();
+      const auto start = std::chrono::steady_clock::now();
+
+      if (auto err = device->readEvents(events); err.isError()) {
+        std::cerr << "Error reading events: " << err.getError().msg << "\n";
+        close(fds[1]);
+        return std::nullopt;
+      }
+
+      if (measure) {
+        result.time += std::chrono::steady_clock::now() - start;
+        result.allocs += allocations.load() - startAllocs;
+      }
+    }
+
+    if (!measure) {
+      result.decodedEvents = events.size();
+    }
+  }
+
+  close(fds[1]);
+  return result;
+}
+
+void
+printResult(const char* name, const Result& result, std::size_t rawEvents) {
+  const auto total = double(rawEvents) * iterations;
+  std::cout << "  " << name << ":\n"
+            << "    decoded events:   " << result.decodedEvents << "\n"
+            << "    ns per event:     " << double(result.time.count()) / total
+            << "\n"
+            << "    allocs per event: " << double(result.allocs) / total
+            << "\n";
+}
+
+} // namespace
+
+int
+main(int argc, char* argv[]) {
+  if (argc > 3) {
+    std::cerr << "Usage: " << argv[0]
+              << " [<recording> | touch|pen|key <raw events>]\n";
+    return EXIT_FAILURE;
+  }
+
+  std::vector<InputReplayer::Stream> streams;
+  if (argc == 1) {
+    streams.push_back({ InputType::Pen, {}, makePenStream() });
+  } else if (argc == 2) {
+    auto replayer = InputReplayer::open(argv[1]);
+    if (replayer.isError()) {
+      std::cerr << replayer.getError().msg << "\n";
+      return EXIT_FAILURE;
+    }
+    streams = (*replayer)->getStreams();
+  } else {
+    const auto type = parseType(argv[1]);
+    if (!type.has_value()) {
+      std::cerr << "Unknown device type: " << argv[1] << "\n";
+      return EXIT_FAILURE;
+    }
+    streams.push_back({ *type, {}, readStream(argv[2]) });
+  }
+
+  bool empty = true;
+  for (const auto& stream : streams) {
+    if (stream.events.empty()) {
+      continue;
+    }
+    empty = false;
+
+    std::cout << typeName(stream.type) << " device\n"
+              << "  raw events: " << stream.events.size() << "\n";
+
+    printResult("decodeEvents", benchDecode(stream), stream.events.size());
+
+    const auto read = benchRead(stream);
+    if (!read.has_value()) {
+      return EXIT_FAILURE;
+    }
+    printResult("readEvents", *read, stream.events.size());
+  }
+
+  if (empty) {
+    std::cerr << "No events to replay\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -1,7 +1,12 @@
 #include <Device.h>
 #include <Input.h>
+#include <InputRecording.h>
 
+#include <csignal>
+#include <cstdlib>
 #include <iostream>
+#include <string>
+#include <string_view>
 
 #include <libudev.h>
 
@@ -103,7 +108,8 @@ printEvent(const TouchEvent& ev) {
       break;
   }
   std::cout << " at " << ev.location.x << "x" << ev.location.y;
-  std::cout << " id " << ev.id << " slot " << ev.slot << std::endl;
+  std::cout << " id " << ev.id << " slot " << ev.slot << " size " << ev.size
+            << std::endl;
 }
 
 void
@@ -147,32 +153,101 @@ printEvent(const KeyEvent& ev) {
   std::cout << ev.keyCode << std::endl;
 }
 
-int
-main() {
-  // struct udev* udev = udev_new();
-  // if (!udev) {
-  //   fprintf(stderr, "udev_new() failed\n");
-  //   return 1;
-  // }
+void
+printGesture(const SwipeGesture& g) {
+  std::cout << "Swipe " << g.direction << " fingers " << g.fingers << " from "
+            << g.startPosition.x << "x" << g.startPosition.y << " velocity "
+            << g.velocityX << "x" << g.velocityY << std::endl;
+}
 
-  // enumerate_devices(udev);
-  // monitor_devices(udev);
+void
+printGesture(const PinchGesture& g) {
+  std::cout << "Pinch " << (g.direction == PinchGesture::In ? "In" : "Out")
+            << " fingers " << g.fingers << " scale " << g.scale << std::endl;
+}
 
-  // udev_unref(udev);
+void
+printGesture(const TapGesture& g) {
+  std::cout << "Tap fingers " << g.fingers << " at " << g.position.x << "x"
+            << g.position.y << std::endl;
+}
 
-  // auto deviceType = device::getDeviceType();
-  // if (deviceType.isError()) {
-  //   std::cerr << "Unknown device\n";
-  //   return -1;
-  // }
+namespace {
+volatile std::sig_atomic_t stop = 0;
+
+void
+onSignal(int) {
+  stop = 1;
+}
+} // namespace
+
+int
+main(int argc, char* argv[]) {
+  const char* recordPath = nullptr;
+  const char* replayPath = nullptr;
+  float speed = 1;
+  std::optional<PalmFilterOptions> palmFilter;
+
+  for (int i = 1; i < argc; i++) {
+    const auto arg = std::string_view(argv[i]);
+    if (arg == "--record" && i + 1 < argc) {
+      recordPath = argv[++i];
+    } else if (arg == "--replay" && i + 1 < argc) {
+      replayPath = argv[++i];
+    } else if (arg == "--speed" && i + 1 < argc) {
+      speed = std::stof(argv[++i]);
+    } else if (arg == "--palm-filter") {
+      palmFilter.emplace();
+    } else if (arg == "--max-touch-size" && i + 1 < argc && palmFilter) {
+      palmFilter->maxTouchSize = std::stoi(argv[++i]);
+    } else {
+      std::cerr << "Usage: " << argv[0]
+                << " [--record file] [--replay file [--speed factor]]"
+                   " [--palm-filter [--max-touch-size size]]\n";
+      return EXIT_FAILURE;
+    }
+  }
 
   InputManager input;
-  auto err = input.openAll();
-  if (err.isError()) {
-    std::cerr << err.getError().msg << std::endl;
+  input.setPalmFilter(palmFilter);
+
+  std::unique_ptr<InputReplayer> replayer;
+  if (replayPath != nullptr) {
+    auto replayerOrErr = InputReplayer::open(replayPath);
+    if (replayerOrErr.isError()) {
+      std::cerr << replayerOrErr.getError().msg << std::endl;
+      return EXIT_FAILURE;
+    }
+    replayer = std::move(*replayerOrErr);
+
+    if (auto err = replayer->start(input, speed); err.isError()) {
+      std::cerr << err.getError().msg << std::endl;
+      return EXIT_FAILURE;
+    }
+  } else {
+    auto err = input.openAll();
+    if (err.isError()) {
+      std::cerr << err.getError().msg << std::endl;
+    }
   }
 
-  while (true) {
+  std::unique_ptr<InputRecorder> recorder;
+  if (recordPath != nullptr) {
+    auto recorderOrErr = InputRecorder::create(recordPath);
+    if (recorderOrErr.isError()) {
+      std::cerr << recorderOrErr.getError().msg << std::endl;
+      return EXIT_FAILURE;
+    }
+    recorder = std::move(*recorderOrErr);
+    recorder->attach(input);
+  }
+
+  std::signal(SIGINT, onSignal);
+  std::signal(SIGTERM, onSignal);
+
+  GestureController gestures;
+
+  while (stop == 0 && (replayer == nullptr || !replayer->isDone())) {
     auto events = input.waitForInput(std::nullopt);
     if (events.isError()) {
       std::cerr << "Reading input error: " << events.getError().msg << "\n";
@@ -182,6 +257,23 @@ main() {
     for (auto& event : *events) {
       std::visit([](auto& e) { printEvent(e); }, event);
     }
+
+    for (const auto& gesture : gestures.handleEvents(*events).first) {
+      std::visit([](const auto& g) { printGesture(g); }, gesture);
+    }
+  }
+
+  if (recorder != nullptr) {
+    std::cout << "Recorded " << recorder->getEventCount() << " events to "
+              << recordPath << std::endl;
+  }
+
+  if (const auto* filter = input.getPalmFilter(); filter != nullptr) {
+    const auto& stats = filter->getStats();
+    std::cout << "Palm filter rejected " << stats.penNearTouches
+              << " touches near the pen and " << stats.largeTouches
+              << " large touches, dropped " << stats.droppedEvents
+              << " events" << std::endl;
   }
 
   return 0;